@@ -0,0 +1,103 @@
+#include "allocation_counter.hpp"
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <malloc.h>
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> frees(0);
+static std::atomic<uint64_t> bytes_allocated(0);
+static std::atomic<uint64_t> bytes_freed(0);
+
+allocation_counters::allocation_counters(void)
+  : allocations(0),
+    frees(0),
+    bytes_allocated(0),
+    bytes_freed(0)
+{}
+
+allocation_counters allocation_counters::operator-(const allocation_counters &other) const
+{
+  allocation_counters result;
+  result.allocations = allocations - other.allocations;
+  result.frees = frees - other.frees;
+  result.bytes_allocated = bytes_allocated - other.bytes_allocated;
+  result.bytes_freed = bytes_freed - other.bytes_freed;
+  return result;
+}
+
+allocation_counters get_allocation_counters(void)
+{
+  allocation_counters result;
+  result.allocations = allocations.load(std::memory_order_relaxed);
+  result.frees = frees.load(std::memory_order_relaxed);
+  result.bytes_allocated = bytes_allocated.load(std::memory_order_relaxed);
+  result.bytes_freed = bytes_freed.load(std::memory_order_relaxed);
+  return result;
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+static void * counted_malloc(size_t n)
+{
+  void *p = malloc(n ? n : 1);
+  if (p) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_allocated.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+  }
+  return p;
+}
+
+static void counted_free(void *p)
+{
+  if (p == NULL)
+    return;
+  frees.fetch_add(1, std::memory_order_relaxed);
+  bytes_freed.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+  free(p);
+}
+
+void * operator new(size_t n)
+{
+  void *p = counted_malloc(n);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](size_t n)
+{
+  return operator new(n);
+}
+
+void * operator new(size_t n, const std::nothrow_t &) noexcept
+{
+  return counted_malloc(n);
+}
+
+void * operator new[](size_t n, const std::nothrow_t &) noexcept
+{
+  return counted_malloc(n);
+}
+
+void operator delete(void *p) noexcept
+{
+  counted_free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  counted_free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  counted_free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  counted_free(p);
+}
+
+#endif // COUNT_ALLOCATIONS
@@ -0,0 +1,37 @@
+// Heap allocation accounting for the benchmarks.
+
+// When COUNT_ALLOCATIONS is defined (see the Makefile),
+// allocation_counter.cpp replaces the global operator new and
+// operator delete, so every allocation made through new is counted,
+// including those made by the standard containers.  The counters are
+// updated with atomic operations on every new and delete, so this is
+// left out of ordinary builds, in which the counters stay at zero.
+// Allocations made directly with malloc() are not counted.  Sizes
+// are the usable sizes reported by the allocator, so they include
+// its rounding but not its per-block headers.
+
+// The counters are global and shared by all threads.
+
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <cstdint>
+
+class allocation_counters {
+public:
+  allocation_counters(void);
+  allocation_counters operator-(const allocation_counters &other) const;
+
+  uint64_t live_bytes(void) const {
+    return bytes_allocated - bytes_freed;
+  }
+
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t bytes_allocated;
+  uint64_t bytes_freed;
+};
+
+allocation_counters get_allocation_counters(void);
+
+#endif // ALLOCATION_COUNTER_HPP
@@ -1,48 +1,423 @@
 #include "backing_store.hpp"
 #include <iostream>
-#include <ext/stdio_filebuf.h>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <cassert>
 
+//////////////////////////////////////////////////////////
+// Default implementation of the buffer-based interface //
+//////////////////////////////////////////////////////////
+void backing_store::read(uint64_t id, buffer_stream &buf) {
+  std::iostream *ios = get(id);
+  std::string contents((std::istreambuf_iterator<char>(*ios)),
+		       std::istreambuf_iterator<char>());
+  put(ios);
+  memcpy(buf.start_read(contents.size()), contents.data(), contents.size());
+}
+
+void backing_store::write(uint64_t id, const char *data, size_t n) {
+  std::iostream *ios = get(id);
+  ios->write(data, n);
+  put(ios);
+}
+
 /////////////////////////////////////////////////////////////
 // Implementation of the one_file_per_object_backing_store //
 /////////////////////////////////////////////////////////////
-one_file_per_object_backing_store::one_file_per_object_backing_store(std::string rt)
+
+one_file_per_object_backing_store::one_file_per_object_backing_store(std::string rt,
+								     durability d)
   : root(rt),
-    nextid(1)
+    mode(d),
+    nextid(1),
+    syncs(0),
+    unsynced(false)
 {}
 
+one_file_per_object_backing_store::~one_file_per_object_backing_store(void)
+{
+  while (!fd_lru.empty())
+    close_file(fd_lru.back());
+  for (auto it = free_streams.begin(); it != free_streams.end(); ++it)
+    delete *it;
+}
+
+std::string one_file_per_object_backing_store::filename(uint64_t id) const {
+  return root + "/" + std::to_string(id);
+}
+
+// Return an open descriptor for object id, opening its file with
+// flags if it is not in the cache, and evicting the least recently
+// used descriptor if the cache is full.
+int one_file_per_object_backing_store::open_file(uint64_t id, int flags) {
+  auto it = fds.find(id);
+  if (it != fds.end()) {
+    fd_lru.splice(fd_lru.begin(), fd_lru, it->second.second);
+    return it->second.first;
+  }
+  if (fds.size() >= FILE_STORE_FD_CACHE_SIZE)
+    close_file(fd_lru.back());
+  int fd = open(filename(id).c_str(), flags, 0644);
+  assert(fd >= 0);
+  fd_lru.push_front(id);
+  fds[id] = std::make_pair(fd, fd_lru.begin());
+  return fd;
+}
+
+void one_file_per_object_backing_store::close_file(uint64_t id) {
+  auto it = fds.find(id);
+  if (it == fds.end())
+    return;
+  close(it->second.first);
+  fd_lru.erase(it->second.second);
+  fds.erase(it);
+}
+
+buffer_stream * one_file_per_object_backing_store::take_stream(void) {
+  if (free_streams.empty())
+    return new buffer_stream;
+  buffer_stream *bs = free_streams.back();
+  free_streams.pop_back();
+  return bs;
+}
+
 uint64_t one_file_per_object_backing_store::allocate(size_t n) {
   uint64_t id = nextid++;
-  std::string filename = root + "/" + std::to_string(id);
-  std::fstream dummy(filename, std::fstream::out);
-  dummy.flush();
-  assert(dummy.good());
+  open_file(id, O_RDWR | O_CREAT | O_TRUNC);
+  unwritten.insert(id);
   return id;
 }
 
 void one_file_per_object_backing_store::deallocate(uint64_t id) {
-  std::string filename = root + "/" + std::to_string(id);
-  assert(unlink(filename.c_str()) == 0);
+  close_file(id);
+  int r = unlink(filename(id).c_str());
+  assert(r == 0);
+  (void)r;
+  unwritten.erase(id);
+  unsynced = true;
+}
+
+void one_file_per_object_backing_store::read_file(uint64_t id, buffer_stream &buf) {
+  int fd = open_file(id, O_RDWR);
+  struct stat st;
+  int r = fstat(fd, &st);
+  assert(r == 0);
+  (void)r;
+  char *p = buf.start_read(st.st_size);
+  for (off_t done = 0; done < st.st_size; ) {
+    ssize_t r = pread(fd, p + done, st.st_size - done, done);
+    assert(r > 0);
+    done += r;
+  }
+}
+
+void one_file_per_object_backing_store::write_file(uint64_t id, const char *data, size_t n) {
+  int fd = open_file(id, O_RDWR);
+  for (size_t done = 0; done < n; ) {
+    ssize_t r = pwrite(fd, data + done, n - done, done);
+    assert(r > 0);
+    done += r;
+  }
+  if (mode == DURABILITY_FULL) {
+    fsync(fd);
+    syncs++;
+  } else if (mode == DURABILITY_ORDERED) {
+    unsynced = true;
+  }
 }
 
 std::iostream * one_file_per_object_backing_store::get(uint64_t id) {
-  __gnu_cxx::stdio_filebuf<char> *fb = new __gnu_cxx::stdio_filebuf<char>;
-  std::string filename = root + "/" + std::to_string(id);
-  fb->open(filename, std::fstream::in | std::fstream::out);
-  std::fstream *ios = new std::fstream;
-  ios->std::ios::rdbuf(fb);
+  buffer_stream *bs = take_stream();
+  // swap_space writes each object exactly once, through the first
+  // get() after allocating it.
+  if (unwritten.erase(id)) {
+    bs->start_write();
+    writes[bs] = id;
+  } else {
+    read_file(id, *bs);
+  }
+  streams[bs] = id;
+  return bs;
+}
+
+void one_file_per_object_backing_store::put(std::iostream *ios)
+{
+  buffer_stream *bs = (buffer_stream *)ios;
+  assert(streams.count(ios) > 0);
+  uint64_t id = streams[ios];
+  streams.erase(ios);
+  auto it = writes.find(ios);
+  if (it != writes.end()) {
+    write_file(id, bs->data(), bs->written());
+    writes.erase(it);
+  }
+  if (free_streams.size() < FILE_STORE_BUFFER_POOL_SIZE)
+    free_streams.push_back(bs);
+  else
+    delete bs;
+}
+
+void one_file_per_object_backing_store::read(uint64_t id, buffer_stream &buf) {
+  read_file(id, buf);
+}
+
+void one_file_per_object_backing_store::write(uint64_t id, const char *data, size_t n) {
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  write_file(id, data, n);
+}
+
+// Files can be rewritten as long as they can be truncated, which
+// keeps a shorter new image from leaving the tail of the old one
+// behind.  If truncating fails, swap_space writes a new object instead.
+bool one_file_per_object_backing_store::overwrite(uint64_t id, size_t n) {
+  if (ftruncate(open_file(id, O_RDWR), 0) != 0)
+    return false;
+  unwritten.insert(id);
+  return true;
+}
+
+// One syncfs() of the store's filesystem makes all the objects
+// written since the last barrier, and the creation and removal of
+// their files, durable at the cost of a single device flush, where
+// fsync()ing each file would flush once per file.
+void one_file_per_object_backing_store::sync(void) {
+  if (mode != DURABILITY_ORDERED || !unsynced)
+    return;
+  int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+  assert(fd >= 0);
+  syncfs(fd);
+  close(fd);
+  syncs++;
+  unsynced = false;
+}
+
+uint64_t one_file_per_object_backing_store::get_number_of_syncs(void) const {
+  return syncs;
+}
+
+///////////////////////////////////////////////////
+// Implementation of the in_memory_backing_store //
+///////////////////////////////////////////////////
+in_memory_backing_store::in_memory_backing_store(uint64_t io_latency_ns,
+						 uint64_t io_bandwidth_bytes_per_sec)
+  : nextid(1),
+    latency_ns(io_latency_ns),
+    bandwidth(io_bandwidth_bytes_per_sec),
+    objects(),
+    open_streams()
+{}
+
+uint64_t in_memory_backing_store::allocate(size_t n) {
+  uint64_t id = nextid++;
+  objects[id] = std::string();
+  return id;
+}
+
+void in_memory_backing_store::deallocate(uint64_t id) {
+  size_t erased = objects.erase(id);
+  assert(erased == 1);
+  (void)erased;
+}
+
+bool in_memory_backing_store::overwrite(uint64_t id, size_t n) {
+  assert(objects.count(id) > 0);
+  objects[id].clear();
+  return true;
+}
+
+std::iostream * in_memory_backing_store::get(uint64_t id) {
+  assert(objects.count(id) > 0);
+  std::stringstream *ios = new std::stringstream(objects[id]);
   ios->exceptions(std::fstream::badbit | std::fstream::failbit | std::fstream::eofbit);
-  assert(ios->good());
-  
+  open_streams[ios] = id;
   return ios;
 }
 
-void one_file_per_object_backing_store::put(std::iostream *ios)
+void in_memory_backing_store::put(std::iostream *ios)
 {
-  ios->flush();
-  __gnu_cxx::stdio_filebuf<char> *fb = (__gnu_cxx::stdio_filebuf<char> *)ios->rdbuf();
-  fsync(fb->fd());
+  assert(open_streams.count(ios) > 0);
+  uint64_t id = open_streams[ios];
+  open_streams.erase(ios);
+  std::stringstream *ss = (std::stringstream *)ios;
+  if (ss->tellp() > 0) {
+    objects[id] = ss->str();
+    charge_io(ss->tellp());
+  } else {
+    charge_io(objects[id].size());
+  }
   delete ios;
-  delete fb;
+}
+
+void in_memory_backing_store::read(uint64_t id, buffer_stream &buf)
+{
+  assert(objects.count(id) > 0);
+  const std::string &contents = objects[id];
+  memcpy(buf.start_read(contents.size()), contents.data(), contents.size());
+  charge_io(contents.size());
+}
+
+void in_memory_backing_store::write(uint64_t id, const char *data, size_t n)
+{
+  assert(objects.count(id) > 0);
+  objects[id].assign(data, n);
+  charge_io(n);
+}
+
+void in_memory_backing_store::charge_io(size_t n)
+{
+  uint64_t ns = latency_ns;
+  if (bandwidth)
+    ns += 1000000000ULL * n / bandwidth;
+  if (ns == 0)
+    return;
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000ULL;
+  ts.tv_nsec = ns % 1000000000ULL;
+  while (nanosleep(&ts, &ts) != 0)
+    ;
+}
+
+////////////////////////////////////////////////////
+// Implementation of the accounting_backing_store //
+////////////////////////////////////////////////////
+accounting_backing_store::counters::counters(void)
+  : allocations(0),
+    deallocations(0),
+    overwrites(0),
+    gets(0),
+    puts(0),
+    reads(0),
+    writes(0),
+    bytes_read(0),
+    bytes_written(0),
+    syncs(0)
+{}
+
+accounting_backing_store::counters
+accounting_backing_store::counters::operator-(const counters &other) const {
+  counters result;
+  result.allocations = allocations - other.allocations;
+  result.deallocations = deallocations - other.deallocations;
+  result.overwrites = overwrites - other.overwrites;
+  result.gets = gets - other.gets;
+  result.puts = puts - other.puts;
+  result.reads = reads - other.reads;
+  result.writes = writes - other.writes;
+  result.bytes_read = bytes_read - other.bytes_read;
+  result.bytes_written = bytes_written - other.bytes_written;
+  result.syncs = syncs - other.syncs;
+  return result;
+}
+
+accounting_backing_store::accounting_backing_store(backing_store *bs)
+  : backstore(bs),
+    totals(),
+    live_bytes(0),
+    sizes(),
+    unwritten()
+{}
+
+uint64_t accounting_backing_store::allocate(size_t n) {
+  uint64_t id = backstore->allocate(n);
+  totals.allocations++;
+  assert(sizes.count(id) == 0);
+  sizes[id] = n;
+  unwritten.insert(id);
+  live_bytes += n;
+  return id;
+}
+
+void accounting_backing_store::deallocate(uint64_t id) {
+  backstore->deallocate(id);
+  totals.deallocations++;
+  assert(sizes.count(id) > 0);
+  live_bytes -= sizes[id];
+  sizes.erase(id);
+  unwritten.erase(id);
+}
+
+std::iostream * accounting_backing_store::get(uint64_t id) {
+  totals.gets++;
+  assert(sizes.count(id) > 0);
+  if (unwritten.erase(id)) {
+    totals.writes++;
+    totals.bytes_written += sizes[id];
+  } else {
+    totals.reads++;
+    totals.bytes_read += sizes[id];
+  }
+  return backstore->get(id);
+}
+
+void accounting_backing_store::put(std::iostream *ios) {
+  totals.puts++;
+  backstore->put(ios);
+}
+
+void accounting_backing_store::read(uint64_t id, buffer_stream &buf) {
+  totals.gets++;
+  totals.puts++;
+  assert(sizes.count(id) > 0);
+  assert(unwritten.count(id) == 0);
+  totals.reads++;
+  totals.bytes_read += sizes[id];
+  backstore->read(id, buf);
+}
+
+void accounting_backing_store::write(uint64_t id, const char *data, size_t n) {
+  totals.gets++;
+  totals.puts++;
+  assert(sizes.count(id) > 0);
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  totals.writes++;
+  totals.bytes_written += sizes[id];
+  backstore->write(id, data, n);
+}
+
+bool accounting_backing_store::overwrite(uint64_t id, size_t n) {
+  assert(sizes.count(id) > 0);
+  if (!backstore->overwrite(id, n))
+    return false;
+  totals.overwrites++;
+  live_bytes = live_bytes - sizes[id] + n;
+  sizes[id] = n;
+  unwritten.insert(id);
+  return true;
+}
+
+void accounting_backing_store::set_is_leaf(uint64_t id, bool is_leaf) {
+  backstore->set_is_leaf(id, is_leaf);
+}
+
+void accounting_backing_store::sync(void) {
+  backstore->sync();
+}
+
+uint64_t accounting_backing_store::get_number_of_syncs(void) const {
+  return backstore->get_number_of_syncs();
+}
+
+accounting_backing_store::counters
+accounting_backing_store::get_counters(void) const {
+  counters result = totals;
+  result.syncs = get_number_of_syncs();
+  return result;
+}
+
+uint64_t accounting_backing_store::get_live_objects(void) const {
+  return sizes.size();
+}
+
+uint64_t accounting_backing_store::get_live_bytes(void) const {
+  return live_bytes;
 }
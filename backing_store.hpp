@@ -7,6 +7,106 @@
 #include <cstdint>
 #include <cstddef>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <list>
+
+// How hard a store works to make written objects survive a crash.
+//   DURABILITY_NONE     never sync; for throwaway trees and bulk loads
+//   DURABILITY_ORDERED  sync only at barriers, i.e. calls to sync()
+//   DURABILITY_FULL     sync every object as it is written
+enum durability {
+  DURABILITY_NONE,
+  DURABILITY_ORDERED,
+  DURABILITY_FULL
+};
+
+// An iostream over a reusable in-memory buffer.  Writers serialize
+// into the buffer, which grows as needed, and hand data() and
+// written() to backing_store::write().  Readers have
+// backing_store::read() fill the buffer with a whole object and
+// deserialize from it in place.  The buffer keeps its capacity from
+// one use to the next, so a stream that has been used a few times no
+// longer allocates.
+class buffer_stream: public std::iostream {
+public:
+  buffer_stream(void)
+    : std::iostream(&buf)
+  {
+    exceptions(std::ios::badbit | std::ios::failbit | std::ios::eofbit);
+  }
+
+  // Make room for n bytes to be read back, and return where to put
+  // them.
+  char * start_read(size_t n) { clear(); return buf.start_read(n); }
+  // Read from n bytes of someone else's memory, e.g. a mapping of
+  // the store's file, without copying them.  The memory must stay
+  // valid, and is never written, while the stream reads it.
+  void borrow(const char *p, size_t n) { clear(); buf.borrow(p, n); }
+  void start_write(void) { clear(); buf.start_write(); }
+  const char * data(void) const { return buf.data.data(); }
+  size_t written(void) const { return buf.written(); }
+  // What start_read() or borrow() made available to read.
+  const char * input(void) const { return buf.input(); }
+  size_t input_size(void) const { return buf.input_size(); }
+
+private:
+  class buffer: public std::streambuf {
+  public:
+    char * start_read(size_t n) {
+      if (data.size() < n)
+	data.resize(n);
+      setg(data.data(), data.data(), data.data() + n);
+      setp(NULL, NULL);
+      return data.data();
+    }
+
+    void borrow(const char *p, size_t n) {
+      char *q = const_cast<char *>(p);
+      setg(q, q, q + n);
+      setp(NULL, NULL);
+    }
+
+    void start_write(void) {
+      if (data.size() < 4096)
+	data.resize(4096);
+      setp(data.data(), data.data() + data.size());
+      setg(NULL, NULL, NULL);
+    }
+
+    size_t written(void) const { return pptr() - pbase(); }
+    const char * input(void) const { return eback(); }
+    size_t input_size(void) const { return egptr() - eback(); }
+
+    std::vector<char> data;
+
+  protected:
+    int_type overflow(int_type c) {
+      size_t used = written();
+      data.resize(2 * data.size());
+      setp(data.data(), data.data() + data.size());
+      pbump(used);
+      if (!traits_type::eq_int_type(c, traits_type::eof())) {
+	*pptr() = c;
+	pbump(1);
+      }
+      return traits_type::not_eof(c);
+    }
+
+    // Enough for tellg() and tellp().
+    pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) {
+      if (off != 0 || dir != std::ios::cur)
+	return pos_type(off_type(-1));
+      if (which & std::ios::in)
+	return gptr() - eback();
+      return pptr() - pbase();
+    }
+  };
+
+  buffer buf;
+};
 
 class backing_store {
 public:
@@ -14,19 +114,163 @@ public:
   virtual void deallocate(uint64_t id) = 0;
   virtual std::iostream * get(uint64_t id) = 0;
   virtual void            put(std::iostream *ios) = 0;
+  virtual ~backing_store(void) {};
+
+  // Buffer-oriented access, so that callers can serialize straight
+  // into, and deserialize straight out of, memory they own.  read()
+  // fills buf with the whole of object id.  write() is the one write
+  // of a newly allocated or overwritten object, like the first get()
+  // and its put().  The defaults are built on get() and put(); stores
+  // override them to skip the intermediate stream.
+  virtual void read(uint64_t id, buffer_stream &buf);
+  virtual void write(uint64_t id, const char *data, size_t n);
+
+  // Prepare to overwrite object id in place with n bytes.  If this
+  // returns true, the next get(id) returns a stream for writing the
+  // new contents.  If it returns false (the default), the store
+  // cannot reuse the object's space, and the caller should allocate
+  // a new object instead.
+  virtual bool overwrite(uint64_t id, size_t n) { return false; }
+
+  // Whether object id, just allocated or prepared for overwriting,
+  // holds a leaf of the tree.  Stores may use it to place objects.
+  virtual void set_is_leaf(uint64_t id, bool is_leaf) {}
+
+  // A barrier: when sync() returns, every object put() before the
+  // call is on stable storage, unless the store's durability is
+  // DURABILITY_NONE.
+  virtual void sync(void) {}
+
+  // Number of times the store has forced data to stable storage.
+  virtual uint64_t get_number_of_syncs(void) const { return 0; }
 };
 
+// The file store keeps up to FILE_STORE_FD_CACHE_SIZE files open, so
+// that accessing a recently used object does not pay for a path
+// lookup and an open() and close(), and reads and writes whole
+// objects with pread() and pwrite() through up to
+// FILE_STORE_BUFFER_POOL_SIZE reusable in-memory streams.
+#define FILE_STORE_FD_CACHE_SIZE (128)
+#define FILE_STORE_BUFFER_POOL_SIZE (8)
+
 class one_file_per_object_backing_store: public backing_store {
 public:
-  one_file_per_object_backing_store(std::string rt);
+  one_file_per_object_backing_store(std::string rt,
+				    durability d = DURABILITY_FULL);
+  ~one_file_per_object_backing_store(void);
   uint64_t	  allocate(size_t n);
   void		  deallocate(uint64_t id);
   std::iostream * get(uint64_t id);
   void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
   
 private:
+  std::string filename(uint64_t id) const;
+  int open_file(uint64_t id, int flags);
+  void close_file(uint64_t id);
+  void read_file(uint64_t id, buffer_stream &buf);
+  void write_file(uint64_t id, const char *data, size_t n);
+  buffer_stream * take_stream(void);
+
   std::string	root;
+  durability	mode;
+  uint64_t	nextid;
+  uint64_t	syncs;
+  // Whether anything was written or deallocated since the last
+  // barrier (DURABILITY_ORDERED only).
+  bool		unsynced;
+  // Objects allocated but not yet written, and streams open for
+  // writing.  Reads never need to be synced.
+  std::unordered_set<uint64_t> unwritten;
+  std::unordered_map<std::iostream *, uint64_t> writes;
+  // Open files, most recently used at the front of fd_lru, and the
+  // object each open stream belongs to.
+  std::unordered_map<uint64_t, std::pair<int, std::list<uint64_t>::iterator> > fds;
+  std::list<uint64_t> fd_lru;
+  std::unordered_map<std::iostream *, uint64_t> streams;
+  std::vector<buffer_stream *> free_streams;
+};
+
+// Keeps objects in RAM, so that benchmarks can measure the CPU cost
+// of the tree and the serializer without any filesystem cost.
+// Optionally, each I/O can be charged a fixed latency plus its size
+// divided by a bandwidth, to emulate a slower device.  A latency or
+// bandwidth of 0 means no charge.
+class in_memory_backing_store: public backing_store {
+public:
+  in_memory_backing_store(uint64_t io_latency_ns = 0,
+			  uint64_t io_bandwidth_bytes_per_sec = 0);
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+
+private:
+  void charge_io(size_t n);
+
   uint64_t	nextid;
+  uint64_t	latency_ns;
+  uint64_t	bandwidth;
+  std::unordered_map<uint64_t, std::string> objects;
+  std::unordered_map<std::iostream *, uint64_t> open_streams;
+};
+
+// A decorator that counts the I/O performed through another
+// backing_store, for measuring read, write and space amplification.
+
+// swap_space always writes an object exactly once, immediately after
+// allocating it with the object's size, and afterwards only reads it
+// in its entirety.  So the first get() or write() of an object is its
+// write, and every later get() or read() reads the size it was
+// allocated with.
+class accounting_backing_store: public backing_store {
+public:
+  class counters {
+  public:
+    counters(void);
+    counters operator-(const counters &other) const;
+
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t overwrites;
+    uint64_t gets;		// get()s, plus read()s and write()s
+    uint64_t puts;		// put()s, plus read()s and write()s
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t syncs;
+  };
+
+  accounting_backing_store(backing_store *bs);
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+  void            set_is_leaf(uint64_t id, bool is_leaf);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
+
+  counters get_counters(void) const;
+  uint64_t get_live_objects(void) const;
+  uint64_t get_live_bytes(void) const;
+
+private:
+  backing_store *backstore;
+  counters totals;
+  uint64_t live_bytes;
+  std::unordered_map<uint64_t, size_t> sizes;
+  std::unordered_set<uint64_t> unwritten;
 };
 
 #endif // BACKING_STORE_HPP
@@ -50,6 +50,9 @@
 // clean in-memory node only requires a write-back, whereas flushing
 // to an on-disk node requires reading it in and writing it out.
 
+#ifndef BETREE_HPP
+#define BETREE_HPP
+
 #include <map>
 #include <vector>
 #include <cassert>
@@ -166,6 +169,21 @@ bool operator==(const Message<Value> &a, const Message<Value> &b) {
   return a.opcode == b.opcode && a.val == b.val;
 }
 
+// Told about the operations performed on a betree before they are
+// performed, e.g. to capture the workload (see
+// workload_trace_recorder in workload_trace.hpp).  See
+// betree::set_recorder().
+template<class Key, class Value>
+class betree_recorder {
+public:
+  virtual ~betree_recorder(void) {}
+  // opcode is INSERT, DELETE or UPDATE.  v is meaningless for DELETE.
+  virtual void upsert(int opcode, const Key &k, const Value &v) = 0;
+  virtual void query(const Key &k) = 0;
+  // A scan() of up to n keys from k.
+  virtual void scan(const Key &k, uint64_t n) = 0;
+};
+
 // Measured in messages.
 #define DEFAULT_MAX_NODE_SIZE (1ULL<<18)
 
@@ -176,8 +194,125 @@ bool operator==(const Message<Value> &a, const Message<Value> &b) {
 
 
 template<class Key, class Value> class betree {
+public:
+
+  // Count, min, mean and max of a set of values.
+  class summary {
+  public:
+    summary(void)
+      : count(0),
+	min(0),
+	max(0),
+	sum(0)
+    {}
+
+    void add(uint64_t x) {
+      if (count == 0 || x < min)
+	min = x;
+      if (count == 0 || x > max)
+	max = x;
+      sum += x;
+      count++;
+    }
+
+    double mean(void) const {
+      return count ? (double)sum / count : 0.0;
+    }
+
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+  };
+
+  class level_statistics {
+  public:
+    level_statistics(void)
+      : nodes(0),
+	resident_nodes(0)
+    {}
+
+    uint64_t nodes;
+    uint64_t resident_nodes;
+    summary size;		// pivots + buffered messages, all nodes
+    summary fanout;		// resident internal nodes only
+    summary buffer_fill;	// buffered messages, resident nodes only
+  };
+
+  // The shape of the tree and cumulative operation counts.  The shape
+  // is gathered by walking only the nodes that are in memory, through
+  // swap_space's peek(), so that stats() never performs I/O and does
+  // not disturb the cache's LRU order or hit counts: a node that is
+  // not in memory is counted (with its size as recorded in its
+  // parent), but the levels below it are not.
+  class statistics {
+  public:
+    statistics(void)
+      : height(1),
+	levels(),
+	queries(0),
+	flushes(0),
+	splits(0)
+    {
+      upserts[INSERT] = upserts[DELETE] = upserts[UPDATE] = 0;
+    }
+
+    void print_prometheus(std::ostream &out) const {
+      static const char *opcodes[] = { "insert", "delete", "update" };
+      out << "# TYPE betree_height gauge" << std::endl
+	  << "betree_height " << height << std::endl;
+      out << "# TYPE betree_upserts_total counter" << std::endl;
+      for (int i = 0; i < 3; i++)
+	out << "betree_upserts_total{opcode=\"" << opcodes[i] << "\"} "
+	    << upserts[i] << std::endl;
+      out << "# TYPE betree_queries_total counter" << std::endl
+	  << "betree_queries_total " << queries << std::endl
+	  << "# TYPE betree_flushes_total counter" << std::endl
+	  << "betree_flushes_total " << flushes << std::endl
+	  << "# TYPE betree_splits_total counter" << std::endl
+	  << "betree_splits_total " << splits << std::endl;
+
+      out << "# TYPE betree_level_nodes gauge" << std::endl;
+      for (size_t i = 0; i < levels.size(); i++)
+	out << "betree_level_nodes{level=\"" << i << "\"} "
+	    << levels[i].nodes << std::endl;
+      out << "# TYPE betree_level_resident_nodes gauge" << std::endl;
+      for (size_t i = 0; i < levels.size(); i++)
+	out << "betree_level_resident_nodes{level=\"" << i << "\"} "
+	    << levels[i].resident_nodes << std::endl;
+      print_summary(out, "betree_level_size", &level_statistics::size);
+      print_summary(out, "betree_level_fanout", &level_statistics::fanout);
+      print_summary(out, "betree_level_buffer_fill", &level_statistics::buffer_fill);
+    }
+
+    uint64_t height;
+    std::vector<level_statistics> levels; // levels[0] is the root
+    uint64_t upserts[3];		  // indexed by opcode
+    uint64_t queries;
+    uint64_t flushes;			  // buffered batches moved to a child
+    uint64_t splits;
+
+  private:
+    void print_summary(std::ostream &out, const char *name,
+		       summary level_statistics::*field) const {
+      const char *stats[] = { "min", "mean", "max" };
+      for (int j = 0; j < 3; j++) {
+	out << "# TYPE " << name << "_" << stats[j] << " gauge" << std::endl;
+	for (size_t i = 0; i < levels.size(); i++) {
+	  const summary &sm = levels[i].*field;
+	  out << name << "_" << stats[j] << "{level=\"" << i << "\"} "
+	      << (j == 0 ? sm.min : j == 1 ? sm.mean() : sm.max) << std::endl;
+	}
+      }
+    }
+  };
+
 private:
 
+  // The serialization microbenchmark builds and (de)serializes nodes
+  // directly.
+  template<class K, class V> friend class serialization_benchmark;
+
   class node;
   // We let a swap_space handle all the I/O.
   typedef typename swap_space::pointer<node> node_pointer;
@@ -324,8 +459,12 @@ private:
     
     // Requires: there are less than MIN_FLUSH_SIZE things in elements
     //           destined for each child in pivots);
-    pivot_map split(betree &bet) {
+    // id is this node's swap_space object id, as in flush().
+    pivot_map split(betree &bet, uint64_t id) {
       assert(pivots.size() + elements.size() >= bet.max_node_size);
+      TRACE_SPAN(span, "split", id);
+      bet.counters.splits++;
+      TRACE_ARG(span, 0, "size", pivots.size() + elements.size());
       // This size split does a good job of causing the resulting
       // nodes to have size between 0.4 * MAX_NODE_SIZE and 0.6 * MAX_NODE_SIZE.
       int num_new_leaves =
@@ -376,12 +515,16 @@ private:
       assert(elt_idx == elements.end());
       pivots.clear();
       elements.clear();
+      TRACE_ARG(span, 1, "new_nodes", result.size());
       return result;
     }
 
     node_pointer merge(betree &bet,
 		       typename pivot_map::iterator begin,
-		       typename pivot_map::iterator end) {
+		       typename pivot_map::iterator end,
+		       uint64_t id) {
+      TRACE_SPAN(span, "merge", id);
+      TRACE_ARG(span, 0, "children", distance(begin, end));
       node_pointer new_node = bet.ss->allocate(new node);
       for (auto it = begin; it != end; ++it) {
 	new_node->elements.insert(it->second.child->elements.begin(),
@@ -392,7 +535,7 @@ private:
       return new_node;
     }
 
-    void merge_small_children(betree &bet) {
+    void merge_small_children(betree &bet, uint64_t id) {
       if (is_leaf())
 	return;
 
@@ -406,7 +549,7 @@ private:
 	  ++endit;
 	}
 	if (endit != beginit) {
-	  node_pointer merged_node = merge(bet, beginit, endit);
+	  node_pointer merged_node = merge(bet, beginit, endit, id);
 	  for (auto tmp = beginit; tmp != endit; ++tmp) {
 	    tmp->second.child->elements.clear();
 	    tmp->second.child->pivots.clear();
@@ -422,22 +565,24 @@ private:
     // Receive a collection of new messages and perform recursive
     // flushes or splits as necessary.  If we split, return a
     // map with the new pivot keys pointing to the new nodes.
-    // Otherwise return an empty map.
-    pivot_map flush(betree &bet, message_map &elts)
+    // Otherwise return an empty map.  id is this node's swap_space
+    // object id, so that its trace events can be matched with its
+    // loads, write-backs and evictions.
+    pivot_map flush(betree &bet, message_map &elts, uint64_t id)
     {
-      debug(std::cout << "Flushing " << this << std::endl);
+      TRACE_SPAN(span, "flush", id);
+      TRACE_ARG(span, 0, "messages", elts.size());
+      TRACE_ARG(span, 1, "size", pivots.size() + elements.size());
       pivot_map result;
 
-      if (elts.size() == 0) {
-	debug(std::cout << "Done (empty input)" << std::endl);
+      if (elts.size() == 0)
 	return result;
-      }
 
       if (is_leaf()) {
 	for (auto it = elts.begin(); it != elts.end(); ++it)
 	  apply(it->first, it->second, bet.default_value);
 	if (elements.size() + pivots.size() >= bet.max_node_size)
-	  result = split(bet);
+	  result = split(bet, id);
 	return result;
       }	
 
@@ -465,7 +610,9 @@ private:
 	  auto elt_end = get_element_begin(next_pivot_idx); 
 	  assert(elt_start == elt_end);
 	}
-      	pivot_map new_children = first_pivot_idx->second.child->flush(bet, elts);
+      	pivot_map new_children =
+	  first_pivot_idx->second.child->flush(bet, elts,
+					       first_pivot_idx->second.child.get_id());
       	if (!new_children.empty()) {
       	  pivots.erase(first_pivot_idx);
       	  pivots.insert(new_children.begin(), new_children.end());
@@ -504,13 +651,16 @@ private:
 	  auto elt_child_it = get_element_begin(child_pivot);
 	  auto elt_next_it = get_element_begin(next_pivot);
 	  message_map child_elts(elt_child_it, elt_next_it);
-	  pivot_map new_children = child_pivot->second.child->flush(bet, child_elts);
+	  bet.counters.flushes++;
+	  pivot_map new_children =
+	    child_pivot->second.child->flush(bet, child_elts,
+					     child_pivot->second.child.get_id());
 	  elements.erase(elt_child_it, elt_next_it);
 	  if (!new_children.empty()) {
 	    pivots.erase(child_pivot);
 	    pivots.insert(new_children.begin(), new_children.end());
 	  } else {
-	    first_pivot_idx->second.child_size =
+	    child_pivot->second.child_size =
 	      child_pivot->second.child->pivots.size() +
 	      child_pivot->second.child->elements.size();
 	  }
@@ -518,19 +668,17 @@ private:
 
 	// We have too many pivots to efficiently flush stuff down, so split
 	if (elements.size() + pivots.size() > bet.max_node_size) {
-	  result = split(bet);
+	  result = split(bet, id);
 	}
       }
 
-      //merge_small_children(bet);
+      //merge_small_children(bet, id);
       
-      debug(std::cout << "Done flushing " << this << std::endl);
       return result;
     }
 
     Value query(const betree & bet, const Key k) const
     {
-      debug(std::cout << "Querying " << this << std::endl);
       if (is_leaf()) {
 	auto it = elements.lower_bound(MessageKey<Key>::range_start(k));
 	if (it != elements.end() && it->first.key == k) {
@@ -584,6 +732,78 @@ private:
       return v;
     }
 
+    // Call f(key, value) for every live key in this subtree, in key
+    // order, given the messages for this subtree still buffered in
+    // its ancestors.  Each node is visited once, and each buffered
+    // message is copied once per level, which is much cheaper than
+    // the root-to-leaf search that iterator::operator++ does for
+    // every message.
+    template<class F>
+    void for_each(const betree &bet, const message_map &pending, F &f) const
+    {
+      if (is_leaf()) {
+	auto a = pending.begin();
+	auto b = elements.begin();
+	while (a != pending.end() || b != elements.end()) {
+	  Key k = (b == elements.end() ||
+		   (a != pending.end() && a->first < b->first)) ?
+	    a->first.key : b->first.key;
+	  bool is_valid = false;
+	  Value v = bet.default_value;
+	  while (true) {
+	    const std::pair<const MessageKey<Key>, Message<Value> > *m;
+	    if (a != pending.end() && a->first.key == k &&
+		(b == elements.end() || b->first.key != k || a->first < b->first))
+	      m = &*a++;
+	    else if (b != elements.end() && b->first.key == k)
+	      m = &*b++;
+	    else
+	      break;
+	    switch (m->second.opcode) {
+	    case INSERT:
+	      v = m->second.val;
+	      is_valid = true;
+	      break;
+	    case UPDATE:
+	      if (!is_valid)
+		v = bet.default_value;
+	      v = v + m->second.val;
+	      is_valid = true;
+	      break;
+	    case DELETE:
+	      is_valid = false;
+	      break;
+	    default:
+	      abort();
+	    }
+	  }
+	  if (is_valid)
+	    f(k, v);
+	}
+	return;
+      }
+
+      for (auto it = pivots.begin(); it != pivots.end(); ++it) {
+	auto next = it;
+	++next;
+	message_map child_pending;
+	if (next == pivots.end()) {
+	  child_pending.insert(pending.lower_bound(MessageKey<Key>::range_start(it->first)),
+			       pending.end());
+	  child_pending.insert(elements.lower_bound(MessageKey<Key>::range_start(it->first)),
+			       elements.end());
+	} else {
+	  MessageKey<Key> lo = MessageKey<Key>::range_start(it->first);
+	  MessageKey<Key> hi = MessageKey<Key>::range_start(next->first);
+	  child_pending.insert(it == pivots.begin() ? pending.begin() : pending.lower_bound(lo),
+			       pending.lower_bound(hi));
+	  child_pending.insert(it == pivots.begin() ? elements.begin() : elements.lower_bound(lo),
+			       elements.lower_bound(hi));
+	}
+	it->second.child->for_each(bet, child_pending, f);
+      }
+    }
+
     std::pair<MessageKey<Key>, Message<Value> >
     get_next_message_from_children(const MessageKey<Key> *mkey) const {
       if (mkey && *mkey < pivots.begin()->first)
@@ -622,6 +842,27 @@ private:
       }
     }
     
+    void collect_stats(statistics &st, size_t level) const {
+      if (st.levels.size() <= level + 1)
+	st.levels.resize(level + 2);
+      st.levels[level].nodes++;
+      st.levels[level].resident_nodes++;
+      st.levels[level].size.add(pivots.size() + elements.size());
+      st.levels[level].buffer_fill.add(elements.size());
+      if (is_leaf())
+	return;
+      st.levels[level].fanout.add(pivots.size());
+      for (auto it = pivots.begin(); it != pivots.end(); ++it) {
+	const node *child = it->second.child.peek();
+	if (child) {
+	  child->collect_stats(st, level + 1);
+	} else {
+	  st.levels[level + 1].nodes++;
+	  st.levels[level + 1].size.add(it->second.child_size);
+	}
+      }
+    }
+
     void _serialize(std::iostream &fs, serialization_context &context) {
       fs << "pivots:" << std::endl;
       serialize(fs, context, pivots);
@@ -646,7 +887,9 @@ private:
   uint64_t min_node_size;
   node_pointer root;
   uint64_t next_timestamp = 1; // Nothing has a timestamp of 0
+  statistics counters;
   Value default_value;
+  betree_recorder<Key, Value> *recorder = NULL;
   
 public:
   betree(swap_space *sspace,
@@ -665,12 +908,16 @@ public:
   // occurs.
   void upsert(int opcode, Key k, Value v)
   {
+    if (recorder)
+      recorder->upsert(opcode, k, v);
     message_map tmp;
     tmp[MessageKey<Key>(k, next_timestamp++)] = Message<Value>(opcode, v);
-    pivot_map new_nodes = root->flush(*this, tmp);
+    counters.upserts[opcode]++;
+    pivot_map new_nodes = root->flush(*this, tmp, root.get_id());
     if (new_nodes.size() > 0) {
       root = ss->allocate(new node);
       root->pivots = new_nodes;
+      counters.height++;
     }
   }
 
@@ -691,10 +938,56 @@ public:
   
   Value query(Key k)
   {
+    if (recorder)
+      recorder->query(k);
+    counters.queries++;
     Value v = root->query(*this, k);
     return v;
   }
 
+  // Call f(key, value) for up to n keys in key order, starting at the
+  // first key not less than k.  Returns the number of keys visited.
+  // Unlike a scan made with lower_bound() and an iterator, this is
+  // recorded by the recorder, if any.
+  template<class F>
+  uint64_t scan(Key k, uint64_t n, F f) const {
+    if (recorder)
+      recorder->scan(k, n);
+    uint64_t visited = 0;
+    for (auto it = lower_bound(k); visited < n && it != end(); ++it, visited++)
+      f(it.first, it.second);
+    return visited;
+  }
+
+  // Call f(key, value) for every key in the tree, in key order.
+  template<class F>
+  void for_each(F f) const {
+    message_map none;
+    root->for_each(*this, none, f);
+  }
+
+  // Report every upsert, query and scan() to r before performing
+  // it, so that recorded inter-arrival times are those of the
+  // requests.  Pass NULL to stop recording.  The tree does not own r.
+  void set_recorder(betree_recorder<Key, Value> *r) {
+    recorder = r;
+  }
+
+  statistics stats(void) const {
+    statistics result = counters;
+    const node *r = root.peek();
+    if (r) {
+      r->collect_stats(result, 0);
+    } else {
+      result.levels.resize(1);
+      result.levels[0].nodes++;
+    }
+    // Drop the empty level collect_stats reserves below the leaves.
+    while (!result.levels.empty() && result.levels.back().nodes == 0)
+      result.levels.pop_back();
+    return result;
+  }
+
   void dump_messages(void) {
     std::pair<MessageKey<Key>, Message<Value> > current;
 
@@ -817,3 +1110,5 @@ public:
     return iterator(*this);
   }
 };
+
+#endif // BETREE_HPP
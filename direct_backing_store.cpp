@@ -0,0 +1,213 @@
+#include "direct_backing_store.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <new>
+
+direct_backing_store::direct_backing_store(std::string root, durability d)
+  : filename(root + "/objects"),
+    mode(d),
+    fd(-1),
+    direct(true),
+    bounce(NULL),
+    bounce_size(0),
+    file_size(0),
+    space(DIRECT_STORE_BLOCK_SIZE),
+    nextid(1),
+    syncs(0),
+    unsynced(false)
+{
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (fd < 0 && errno == EINVAL) {
+    direct = false;
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  }
+  assert(fd >= 0);
+}
+
+direct_backing_store::~direct_backing_store(void)
+{
+  free(bounce);
+  close(fd);
+  if (extents.empty())
+    unlink(filename.c_str());
+}
+
+uint64_t direct_backing_store::round_up(uint64_t n)
+{
+  return (n + DIRECT_STORE_BLOCK_SIZE - 1) / DIRECT_STORE_BLOCK_SIZE
+    * DIRECT_STORE_BLOCK_SIZE;
+}
+
+// A block-aligned buffer of at least n bytes, n a multiple of the
+// block size.
+char * direct_backing_store::bounce_buffer(uint64_t n)
+{
+  if (n > bounce_size) {
+    free(bounce);
+    bounce = NULL;
+    bounce_size = 0;
+    void *p;
+    if (posix_memalign(&p, DIRECT_STORE_BLOCK_SIZE, n) != 0)
+      throw std::bad_alloc();
+    bounce = (char *)p;
+    bounce_size = n;
+  }
+  return bounce;
+}
+
+void direct_backing_store::pread_all(char *p, uint64_t n, uint64_t offset)
+{
+  for (uint64_t done = 0; done < n; ) {
+    ssize_t r = pread(fd, p + done, n - done, offset + done);
+    assert(r > 0);
+    done += r;
+  }
+}
+
+void direct_backing_store::pwrite_all(const char *p, uint64_t n, uint64_t offset)
+{
+  for (uint64_t done = 0; done < n; ) {
+    ssize_t r = pwrite(fd, p + done, n - done, offset + done);
+    assert(r > 0);
+    done += r;
+  }
+  if (offset + n > file_size)
+    file_size = offset + n;
+  if (mode == DURABILITY_FULL) {
+    fdatasync(fd);
+    syncs++;
+  } else if (mode == DURABILITY_ORDERED) {
+    unsynced = true;
+  }
+}
+
+// Move up to FREE_SPACE_DEFRAG_STEP of the highest-addressed objects
+// into free space lower in the file.
+void direct_backing_store::defragment(void)
+{
+  for (int i = 0; i < FREE_SPACE_DEFRAG_STEP && space.should_defragment(); i++) {
+    auto last = owners.rbegin();
+    if (last == owners.rend() || unwritten.count(last->second))
+      break;
+    uint64_t id = last->second;
+    extent &e = extents[id];
+    uint64_t offset = space.allocate(e.capacity);
+    if (offset > e.offset) {
+      space.free(offset, e.capacity);
+      break;
+    }
+    uint64_t n = round_up(e.length);
+    char *p = bounce_buffer(n);
+    pread_all(p, n, e.offset);
+    pwrite_all(p, n, offset);
+    owners.erase(e.offset);
+    space.free(e.offset, e.capacity);
+    e.offset = offset;
+    owners[offset] = id;
+    space.count_relocation();
+  }
+}
+
+uint64_t direct_backing_store::allocate(size_t n)
+{
+  uint64_t id = nextid++;
+  extent &e = extents[id];
+  e.offset = space.allocate(n);
+  e.length = n;
+  e.capacity = space.round_up(n);
+  owners[e.offset] = id;
+  unwritten.insert(id);
+  return id;
+}
+
+void direct_backing_store::deallocate(uint64_t id)
+{
+  assert(extents.count(id) > 0);
+  extent &e = extents[id];
+  space.free(e.offset, e.capacity);
+  owners.erase(e.offset);
+  extents.erase(id);
+  unwritten.erase(id);
+  defragment();
+  // Failing to give space back to the file system is harmless: the
+  // file just stays longer than it needs to be.
+  if (space.size() < file_size / 2 && ftruncate(fd, space.size()) == 0)
+    file_size = space.size();
+}
+
+bool direct_backing_store::overwrite(uint64_t id, size_t n)
+{
+  assert(extents.count(id) > 0);
+  extent &e = extents[id];
+  if (n > e.capacity)
+    return false;
+  e.length = n;
+  unwritten.insert(id);
+  return true;
+}
+
+void direct_backing_store::read(uint64_t id, buffer_stream &buf)
+{
+  assert(extents.count(id) > 0);
+  const extent &e = extents[id];
+  uint64_t n = round_up(e.length);
+  char *p = bounce_buffer(n);
+  pread_all(p, n, e.offset);
+  buf.borrow(p, e.length);
+}
+
+void direct_backing_store::write(uint64_t id, const char *data, size_t n)
+{
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  extent &e = extents[id];
+  assert(n <= e.capacity);
+  e.length = n;
+  uint64_t padded = round_up(n);
+  char *p = bounce_buffer(padded);
+  memcpy(p, data, n);
+  memset(p + n, 0, padded - n);
+  pwrite_all(p, padded, e.offset);
+}
+
+std::iostream * direct_backing_store::get(uint64_t id)
+{
+  buffer_stream *bs = new buffer_stream;
+  if (unwritten.count(id)) {
+    bs->start_write();
+    writes[bs] = id;
+  } else {
+    read(id, *bs);
+  }
+  return bs;
+}
+
+void direct_backing_store::put(std::iostream *ios)
+{
+  buffer_stream *bs = (buffer_stream *)ios;
+  auto it = writes.find(ios);
+  if (it != writes.end()) {
+    write(it->second, bs->data(), bs->written());
+    writes.erase(it);
+  }
+  delete bs;
+}
+
+void direct_backing_store::sync(void)
+{
+  if (mode != DURABILITY_ORDERED || !unsynced)
+    return;
+  fdatasync(fd);
+  syncs++;
+  unsynced = false;
+}
+
+uint64_t direct_backing_store::get_number_of_syncs(void) const
+{
+  return syncs;
+}
@@ -0,0 +1,83 @@
+// A backing_store that bypasses the kernel page cache.
+
+// All objects live in a single file, "objects", in the store's
+// directory, opened with O_DIRECT, so that swap_space is the only
+// cache of node images and the tree's memory use is exactly what
+// swap_space accounts for.  O_DIRECT requires the file offset, the
+// length and the memory address of every transfer to be multiples
+// of the device's block size, so each object gets an extent rounded
+// up to DIRECT_STORE_BLOCK_SIZE, and all I/O goes through a bounce
+// buffer aligned to it.  read() lends the bounce buffer to the
+// deserializer (see buffer_stream::borrow()), so it is valid only
+// until the next read() or write().
+
+// Filesystems that do not support O_DIRECT, such as tmpfs, refuse to
+// open the file with it.  The store then falls back to buffered I/O
+// and is_direct() returns false.
+
+// Extents are managed by a free_space_manager, which reuses freed
+// space.  Deallocations defragment the file incrementally, and the
+// file is truncated when its used part falls below half of it.  An
+// overwrite in place is allowed when the new image fits in the
+// object's extent.  The extent map is not persisted, so, like the
+// other stores, this one cannot be reopened.
+
+#ifndef DIRECT_BACKING_STORE_HPP
+#define DIRECT_BACKING_STORE_HPP
+
+#include "backing_store.hpp"
+#include "free_space_manager.hpp"
+#include <map>
+
+#define DIRECT_STORE_BLOCK_SIZE (4096)
+
+class direct_backing_store: public backing_store {
+public:
+  direct_backing_store(std::string root, durability d = DURABILITY_FULL);
+  ~direct_backing_store(void);
+
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
+
+  bool is_direct(void) const { return direct; }
+  free_space_manager::statistics free_space_stats(void) const { return space.stats(); }
+
+private:
+  class extent {
+  public:
+    uint64_t offset;
+    uint64_t length;		// of the object's current image
+    uint64_t capacity;		// of the extent, a multiple of the block size
+  };
+
+  static uint64_t round_up(uint64_t n);
+  char * bounce_buffer(uint64_t n);
+  void pread_all(char *p, uint64_t n, uint64_t offset);
+  void pwrite_all(const char *p, uint64_t n, uint64_t offset);
+  void defragment(void);
+
+  std::string	filename;
+  durability	mode;
+  int		fd;
+  bool		direct;
+  char *	bounce;
+  uint64_t	bounce_size;
+  uint64_t	file_size;
+  free_space_manager space;
+  uint64_t	nextid;
+  uint64_t	syncs;
+  bool		unsynced;
+  std::unordered_map<uint64_t, extent> extents;
+  std::map<uint64_t, uint64_t> owners;	// extent offset -> object id
+  std::unordered_set<uint64_t> unwritten;
+  std::unordered_map<std::iostream *, uint64_t> writes;
+};
+
+#endif // DIRECT_BACKING_STORE_HPP
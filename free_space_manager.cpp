@@ -0,0 +1,127 @@
+#include "free_space_manager.hpp"
+#include <cassert>
+
+// How many extents of an allocation's own class to try before
+// falling back to a class in which every extent fits.
+#define FIRST_FIT_PROBES (8)
+
+free_space_manager::statistics::statistics(void)
+  : size(0),
+    free_bytes(0),
+    free_extents(0),
+    relocations(0)
+{}
+
+free_space_manager::free_space_manager(uint64_t bs)
+  : block_size(bs),
+    end(0),
+    free_bytes(0),
+    relocations(0),
+    extents(),
+    classes(64)
+{}
+
+uint64_t free_space_manager::round_up(uint64_t n) const
+{
+  if (n == 0)
+    n = 1;
+  return (n + block_size - 1) / block_size * block_size;
+}
+
+int free_space_manager::size_class(uint64_t blocks)
+{
+  return 63 - __builtin_clzll(blocks);
+}
+
+void free_space_manager::insert(uint64_t offset, uint64_t length)
+{
+  extents[offset] = length;
+  classes[size_class(length / block_size)].insert(offset);
+  free_bytes += length;
+}
+
+void free_space_manager::remove(std::map<uint64_t, uint64_t>::iterator it)
+{
+  classes[size_class(it->second / block_size)].erase(it->first);
+  free_bytes -= it->second;
+  extents.erase(it);
+}
+
+uint64_t free_space_manager::allocate(uint64_t n)
+{
+  n = round_up(n);
+  int c = size_class(n / block_size);
+
+  uint64_t offset = 0;
+  bool found = false;
+  int probes = 0;
+  for (auto it = classes[c].begin();
+       it != classes[c].end() && probes < FIRST_FIT_PROBES;
+       ++it, ++probes) {
+    if (extents[*it] >= n) {
+      offset = *it;
+      found = true;
+      break;
+    }
+  }
+  for (int k = c + 1; !found && k < (int)classes.size(); k++) {
+    if (!classes[k].empty()) {
+      offset = *classes[k].begin();
+      found = true;
+    }
+  }
+
+  if (!found) {
+    offset = end;
+    end += n;
+    return offset;
+  }
+
+  auto it = extents.find(offset);
+  uint64_t length = it->second;
+  remove(it);
+  if (length > n)
+    insert(offset + n, length - n);
+  return offset;
+}
+
+void free_space_manager::free(uint64_t offset, uint64_t n)
+{
+  n = round_up(n);
+  assert(offset + n <= end);
+
+  auto next = extents.find(offset + n);
+  if (next != extents.end()) {
+    n += next->second;
+    remove(next);
+  }
+  auto prev = extents.lower_bound(offset);
+  if (prev != extents.begin()) {
+    --prev;
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      n += prev->second;
+      remove(prev);
+    }
+  }
+
+  if (offset + n == end)
+    end = offset;
+  else
+    insert(offset, n);
+}
+
+bool free_space_manager::should_defragment(void) const
+{
+  return free_bytes > FREE_SPACE_DEFRAG_THRESHOLD * end;
+}
+
+free_space_manager::statistics free_space_manager::stats(void) const
+{
+  statistics result;
+  result.size = end;
+  result.free_bytes = free_bytes;
+  result.free_extents = extents.size();
+  result.relocations = relocations;
+  return result;
+}
@@ -0,0 +1,70 @@
+// Space management for stores that keep many objects in one file.
+
+// The file is divided into blocks of a fixed size, and each object
+// occupies an extent of whole blocks.  Free extents are kept in
+// segregated size classes, class k holding the extents of 2^k to
+// 2^(k+1)-1 blocks, each class ordered by offset.  An allocation
+// takes the lowest-addressed extent from the smallest class that is
+// sure to fit it (after a short first-fit search of its own class)
+// and returns the remainder to the free lists.  Freed extents are
+// coalesced with their free neighbours, and free space at the end of
+// the file is given back, so size() only grows when no free extent
+// is large enough.
+
+// The manager only does the bookkeeping.  The stores that use it
+// move data to defragment the file: when more than
+// FREE_SPACE_DEFRAG_THRESHOLD of it is free, each deallocation
+// relocates up to FREE_SPACE_DEFRAG_STEP of the highest-addressed
+// objects into holes lower in the file, so that the end of the file
+// is freed and the file shrinks.
+
+#ifndef FREE_SPACE_MANAGER_HPP
+#define FREE_SPACE_MANAGER_HPP
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#define FREE_SPACE_DEFRAG_THRESHOLD (0.25)
+#define FREE_SPACE_DEFRAG_STEP (4)
+
+class free_space_manager {
+public:
+  class statistics {
+  public:
+    statistics(void);
+
+    uint64_t size;		// end of the last allocated extent
+    uint64_t free_bytes;	// in free extents below size
+    uint64_t free_extents;
+    uint64_t relocations;	// objects moved by the store to defragment
+  };
+
+  free_space_manager(uint64_t block_size);
+
+  uint64_t round_up(uint64_t n) const;
+  // Return the offset of a free extent of round_up(n) bytes.
+  uint64_t allocate(uint64_t n);
+  void free(uint64_t offset, uint64_t n);
+
+  uint64_t size(void) const { return end; }
+  bool should_defragment(void) const;
+  void count_relocation(void) { relocations++; }
+  statistics stats(void) const;
+
+private:
+  static int size_class(uint64_t blocks);
+  void insert(uint64_t offset, uint64_t length);
+  void remove(std::map<uint64_t, uint64_t>::iterator it);
+
+  uint64_t block_size;
+  uint64_t end;
+  uint64_t free_bytes;
+  uint64_t relocations;
+  // Free extents by offset, and the offsets of those in each class.
+  std::map<uint64_t, uint64_t> extents;
+  std::vector<std::set<uint64_t> > classes;
+};
+
+#endif // FREE_SPACE_MANAGER_HPP
@@ -0,0 +1,270 @@
+#include "frozen_betree.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+// The sizes of levels 0, 1, ... of the search tree over n keys.
+static std::vector<uint64_t> level_sizes_for(uint64_t n, uint64_t fanout)
+{
+  std::vector<uint64_t> sizes(1, n);
+  while (sizes.back() > fanout)
+    sizes.push_back((sizes.back() + fanout - 1) / fanout);
+  return sizes;
+}
+
+static uint64_t align_up(uint64_t n)
+{
+  return (n + FROZEN_BETREE_ALIGNMENT - 1) / FROZEN_BETREE_ALIGNMENT
+    * FROZEN_BETREE_ALIGNMENT;
+}
+
+////////////////////////////////////////////////
+// Implementation of the frozen_betree_writer //
+////////////////////////////////////////////////
+frozen_betree_writer::frozen_betree_writer(void)
+  : fd(-1),
+    offset(0),
+    value_bytes(0),
+    failed(false)
+{}
+
+frozen_betree_writer::~frozen_betree_writer(void)
+{
+  close();
+}
+
+bool frozen_betree_writer::open(const char *filename)
+{
+  close();
+  fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  offset = 0;
+  value_bytes = 0;
+  buffer.clear();
+  buffer.reserve(FROZEN_BETREE_WRITE_BUFFER_SIZE);
+  keys.clear();
+  value_ends.clear();
+  failed = false;
+  // The header is filled in by close().
+  char header[FROZEN_BETREE_HEADER_SIZE] = { 0 };
+  return put(header, sizeof(header));
+}
+
+bool frozen_betree_writer::flush(void)
+{
+  for (size_t done = 0; done < buffer.size() && !failed; ) {
+    ssize_t r = ::write(fd, buffer.data() + done, buffer.size() - done);
+    if (r <= 0)
+      failed = true;
+    else
+      done += r;
+  }
+  buffer.clear();
+  return !failed;
+}
+
+bool frozen_betree_writer::put(const void *p, size_t n)
+{
+  buffer.append((const char *)p, n);
+  offset += n;
+  if (buffer.size() >= FROZEN_BETREE_WRITE_BUFFER_SIZE)
+    return flush();
+  return !failed;
+}
+
+bool frozen_betree_writer::align(void)
+{
+  static const char zeros[FROZEN_BETREE_ALIGNMENT] = { 0 };
+  return put(zeros, align_up(offset) - offset);
+}
+
+bool frozen_betree_writer::add(uint64_t key, const std::string &value)
+{
+  assert(fd >= 0);
+  assert(keys.empty() || keys.back() < key);
+  keys.push_back(key);
+  value_bytes += value.size();
+  value_ends.push_back(value_bytes);
+  return put(value.data(), value.size());
+}
+
+bool frozen_betree_writer::close(void)
+{
+  if (fd < 0)
+    return true;
+
+  uint64_t header[FROZEN_BETREE_HEADER_SIZE / 8];
+  memcpy(&header[0], FROZEN_BETREE_MAGIC, 8);
+  header[1] = keys.size();
+  header[2] = FROZEN_BETREE_FANOUT;
+  header[3] = FROZEN_BETREE_HEADER_SIZE;
+
+  align();
+  header[4] = offset;
+  put(value_ends.data(), value_ends.size() * sizeof(uint64_t));
+  align();
+  header[5] = offset;
+  put(keys.data(), keys.size() * sizeof(uint64_t));
+  align();
+  header[6] = offset;
+
+  // Each level of the index keeps every FANOUT-th key of the level
+  // below it.
+  std::vector<uint64_t> sizes = level_sizes_for(keys.size(), FROZEN_BETREE_FANOUT);
+  std::vector<uint64_t> level, below;
+  below.swap(keys);
+  for (size_t l = 1; l < sizes.size(); l++) {
+    level.clear();
+    for (uint64_t i = 0; i < below.size(); i += FROZEN_BETREE_FANOUT)
+      level.push_back(below[i]);
+    assert(level.size() == sizes[l]);
+    put(level.data(), level.size() * sizeof(uint64_t));
+    align();
+    below.swap(level);
+  }
+  header[7] = offset;
+  flush();
+
+  if (!failed && pwrite(fd, header, sizeof(header), 0) != sizeof(header))
+    failed = true;
+  bool ok = !failed && fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  fd = -1;
+  keys.clear();
+  value_ends.clear();
+  return ok;
+}
+
+/////////////////////////////////////////
+// Implementation of the frozen_betree //
+/////////////////////////////////////////
+frozen_betree::frozen_betree(void)
+  : map(NULL),
+    map_size(0),
+    records(0),
+    fanout(0),
+    values(NULL),
+    value_ends(NULL)
+{}
+
+frozen_betree::~frozen_betree(void)
+{
+  close();
+}
+
+bool frozen_betree::open(const char *filename)
+{
+  close();
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < FROZEN_BETREE_HEADER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  map = (const char *)p;
+  map_size = st.st_size;
+
+  const uint64_t *header = (const uint64_t *)map;
+  records = header[1];
+  fanout = header[2];
+  uint64_t values_offset = header[3];
+  uint64_t ends_offset = header[4];
+  uint64_t keys_offset = header[5];
+  uint64_t index_offset = header[6];
+  if (memcmp(map, FROZEN_BETREE_MAGIC, 8) != 0 ||
+      fanout < 2 ||
+      header[7] != map_size ||
+      ends_offset % FROZEN_BETREE_ALIGNMENT != 0 ||
+      keys_offset % FROZEN_BETREE_ALIGNMENT != 0 ||
+      index_offset % FROZEN_BETREE_ALIGNMENT != 0 ||
+      ends_offset < values_offset ||
+      keys_offset < ends_offset + records * sizeof(uint64_t) ||
+      index_offset < keys_offset + records * sizeof(uint64_t)) {
+    close();
+    return false;
+  }
+  values = map + values_offset;
+  value_ends = (const uint64_t *)(map + ends_offset);
+
+  level_sizes = level_sizes_for(records, fanout);
+  levels.push_back((const uint64_t *)(map + keys_offset));
+  uint64_t level_offset = index_offset;
+  for (size_t l = 1; l < level_sizes.size(); l++) {
+    levels.push_back((const uint64_t *)(map + level_offset));
+    level_offset = align_up(level_offset + level_sizes[l] * sizeof(uint64_t));
+  }
+  if (level_offset > map_size ||
+      (records > 0 && value_ends[records - 1] > ends_offset - values_offset)) {
+    close();
+    return false;
+  }
+
+  // Lookups jump around the values and leaves, but every one of them
+  // goes through the index.
+  madvise(p, map_size, MADV_RANDOM);
+  madvise((char *)p + index_offset, map_size - index_offset, MADV_WILLNEED);
+  return true;
+}
+
+void frozen_betree::close(void)
+{
+  if (map)
+    munmap((void *)map, map_size);
+  map = NULL;
+  map_size = 0;
+  records = 0;
+  fanout = 0;
+  values = NULL;
+  value_ends = NULL;
+  levels.clear();
+  level_sizes.clear();
+}
+
+bool frozen_betree::get(uint64_t key, const char *&value, size_t &length) const
+{
+  if (records == 0)
+    return false;
+
+  // Descend from the root, finding the last key <= key in one node of
+  // each level.
+  uint64_t lo = 0;
+  uint64_t hi = level_sizes.back();
+  for (size_t l = levels.size() - 1; ; l--) {
+    const uint64_t *keys = levels[l];
+    uint64_t i = std::upper_bound(keys + lo, keys + hi, key) - keys;
+    if (i == lo)
+      return false;
+    i--;
+    if (l == 0) {
+      if (keys[i] != key)
+	return false;
+      uint64_t start = i > 0 ? value_ends[i - 1] : 0;
+      value = values + start;
+      length = value_ends[i] - start;
+      return true;
+    }
+    lo = i * fanout;
+    hi = std::min(lo + fanout, level_sizes[l - 1]);
+  }
+}
+
+bool frozen_betree::query(uint64_t key, std::string &value) const
+{
+  const char *p;
+  size_t n;
+  if (!get(key, p, n))
+    return false;
+  value.assign(p, n);
+  return true;
+}
@@ -0,0 +1,105 @@
+// A read-only image of a betree with uint64_t keys, for serving a
+// tree that never changes.
+
+// A frozen tree has no buffers: it is built from the tree's final
+// key/value pairs (e.g. with betree::for_each()), so every message has
+// already been applied.  The pairs are laid out as a static search
+// tree with implicit child positions, and the image is used in place
+// through a read-only mmap, so queries do no deserialization, no
+// allocation, no reference counting and no cache bookkeeping.
+
+// The file is
+//
+//   header       FROZEN_BETREE_HEADER_SIZE bytes:
+//                  8 bytes  FROZEN_BETREE_MAGIC
+//                  u64      number of records, n
+//                  u64      fanout, B
+//                  u64      offset of the values
+//                  u64      offset of the value ends
+//                  u64      offset of the keys
+//                  u64      offset of the index
+//                  u64      size of the file
+//   values       the values, back to back, in key order
+//   value ends   u64[n]: value i ends at value_ends[i] and starts at
+//                value_ends[i - 1] (or 0)
+//   keys         u64[n], sorted
+//   index        levels 1, 2, ..., each holding every B-th key of the
+//                level below it, until a level has at most B keys.
+//                Level 0 is the keys themselves.
+//
+// Every section after the values starts on a FROZEN_BETREE_ALIGNMENT
+// boundary, so each node of B keys occupies whole cache lines.  The
+// children of key i of a level are keys i*B ... i*B + B - 1 of the
+// level below it.  Integers are in the host's byte order, since the
+// image is meant to be read where it was written.
+
+#ifndef FROZEN_BETREE_HPP
+#define FROZEN_BETREE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define FROZEN_BETREE_MAGIC "BeTrFRZ1"
+#define FROZEN_BETREE_HEADER_SIZE (64)
+#define FROZEN_BETREE_FANOUT (64)
+#define FROZEN_BETREE_ALIGNMENT (64)
+#define FROZEN_BETREE_WRITE_BUFFER_SIZE (1ULL << 20)
+
+class frozen_betree_writer {
+public:
+  frozen_betree_writer(void);
+  ~frozen_betree_writer(void);
+
+  bool open(const char *filename);
+  // Keys must be added in strictly increasing order.
+  bool add(uint64_t key, const std::string &value);
+  // Write the keys and index, sync and close the file.  Returns false
+  // if any write failed.
+  bool close(void);
+
+  uint64_t get_records(void) const { return keys.size(); }
+  uint64_t get_bytes(void) const { return offset; }
+
+private:
+  bool put(const void *p, size_t n);
+  bool align(void);
+  bool flush(void);
+
+  int fd;
+  uint64_t offset;		// of the next byte to be added
+  uint64_t value_bytes;
+  std::string buffer;
+  std::vector<uint64_t> keys;
+  std::vector<uint64_t> value_ends;
+  bool failed;
+};
+
+class frozen_betree {
+public:
+  frozen_betree(void);
+  ~frozen_betree(void);
+
+  bool open(const char *filename);
+  void close(void);
+
+  // Point value at key's value inside the image.  It remains valid
+  // until the tree is closed.
+  bool get(uint64_t key, const char *&value, size_t &length) const;
+  bool query(uint64_t key, std::string &value) const;
+  uint64_t size(void) const { return records; }
+
+private:
+  const char *map;
+  size_t map_size;
+  uint64_t records;
+  uint64_t fanout;
+  const char *values;
+  const uint64_t *value_ends;
+  // levels[0] is the keys, levels.back() the root.
+  std::vector<const uint64_t *> levels;
+  std::vector<uint64_t> level_sizes;
+};
+
+#endif // FROZEN_BETREE_HPP
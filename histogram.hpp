@@ -0,0 +1,128 @@
+// A log-linear latency histogram in the style of HdrHistogram.
+
+// Values are bucketed by their most significant bit, and each
+// power-of-two range is further divided into 2^SUB_BUCKET_BITS linear
+// sub-buckets.  This bounds the relative error of any reported
+// percentile to 2^-SUB_BUCKET_BITS (about 3%) while keeping the
+// histogram a small, fixed-size array, so recording a value costs a
+// couple of shifts and an increment.
+
+// Latencies are recorded in nanoseconds, as measured by now_ns().
+
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cassert>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+// A cheap monotonic clock.  On Linux, CLOCK_MONOTONIC is serviced by
+// the vDSO, so this does not enter the kernel.
+static inline uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+#define SUB_BUCKET_BITS (5)
+
+class latency_histogram {
+public:
+  latency_histogram(void)
+    : counts(NUM_BUCKETS << SUB_BUCKET_BITS, 0),
+      total(0),
+      maximum(0)
+  {}
+
+  void record(uint64_t value) {
+    counts[index_of(value)]++;
+    total++;
+    if (value > maximum)
+      maximum = value;
+  }
+
+  void merge(const latency_histogram &other) {
+    for (size_t i = 0; i < counts.size(); i++)
+      counts[i] += other.counts[i];
+    total += other.total;
+    if (other.maximum > maximum)
+      maximum = other.maximum;
+  }
+
+  void clear(void) {
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    maximum = 0;
+  }
+
+  uint64_t count(void) const {
+    return total;
+  }
+
+  uint64_t max(void) const {
+    return maximum;
+  }
+
+  // Return the highest value equivalent to the p-th percentile
+  // (0 <= p <= 100), clamped to the largest recorded value.
+  uint64_t percentile(double p) const {
+    if (total == 0)
+      return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if (rank < 1)
+      rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+	uint64_t v = highest_equivalent_value(i);
+	return v < maximum ? v : maximum;
+      }
+    }
+    return maximum;
+  }
+
+  // Print a one-line summary.  All latencies are in nanoseconds.
+  void print(const char *phase) const {
+    printf("# %s latency (ns): count %lu p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+	   phase, total, percentile(50), percentile(90), percentile(99),
+	   percentile(99.9), maximum);
+  }
+
+private:
+  static const int NUM_BUCKETS = 64 - SUB_BUCKET_BITS + 1;
+
+  // Bucket 0 holds values below 2^SUB_BUCKET_BITS exactly.  Bucket b
+  // >= 1 holds values whose most significant bit is
+  // b + SUB_BUCKET_BITS - 1, indexed by the SUB_BUCKET_BITS bits
+  // following the most significant one.
+  static size_t index_of(uint64_t value) {
+    if (value < (1ULL << SUB_BUCKET_BITS))
+      return value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+    size_t bucket = shift + 1;
+    size_t sub = (value >> shift) & ((1ULL << SUB_BUCKET_BITS) - 1);
+    return (bucket << SUB_BUCKET_BITS) + sub;
+  }
+
+  static uint64_t highest_equivalent_value(size_t index) {
+    size_t bucket = index >> SUB_BUCKET_BITS;
+    size_t sub = index & ((1ULL << SUB_BUCKET_BITS) - 1);
+    if (bucket == 0)
+      return sub;
+    int shift = bucket - 1;
+    uint64_t low = ((1ULL << SUB_BUCKET_BITS) + sub) << shift;
+    return low + ((1ULL << shift) - 1);
+  }
+
+  std::vector<uint64_t> counts;
+  uint64_t total;
+  uint64_t maximum;
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,274 @@
+// Key distributions for the benchmarks.
+
+// A key_distribution draws keys from [0, n), where n is passed to
+// each call to next() so that distributions can follow a key space
+// that grows as a workload inserts records.  Each distribution owns
+// its own random_generator, so a benchmark thread that owns its
+// distribution never shares random state with another thread.
+
+// The supported distributions are
+//   uniform            every key equally likely
+//   zipfian            zipfian with skew theta, scrambled so that the
+//                      popular keys are spread across the key space
+//   sequential         0, 1, 2, ..., n-1, 0, 1, ...
+//   reverse-sequential n-1, n-2, ..., 0, n-1, ...
+//   latest             zipfian over recency: key n-1 is the most
+//                      popular, then n-2, and so on
+//   hotspot            HOTSPOT_OPERATION_FRACTION of the requests go
+//                      uniformly to the first HOTSPOT_KEY_FRACTION of
+//                      the key space, the rest uniformly to the others
+
+#ifndef KEY_DISTRIBUTION_HPP
+#define KEY_DISTRIBUTION_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+#define DEFAULT_ZIPFIAN_THETA (0.99)
+#define HOTSPOT_KEY_FRACTION (0.2)
+#define HOTSPOT_OPERATION_FRACTION (0.8)
+
+// xoshiro256** (Blackman and Vigna), seeded with splitmix64.  Much
+// faster than rand(), with far better statistical quality, and no
+// hidden global state.
+class random_generator {
+public:
+  random_generator(uint64_t seed = 0) {
+    reseed(seed);
+  }
+
+  void reseed(uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      s[i] = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t next(void) {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // Uniform in [0, n), by Lemire's multiply-shift reduction.
+  uint64_t uniform(uint64_t n) {
+    return ((unsigned __int128)next() * n) >> 64;
+  }
+
+  // Uniform in [0, 1).
+  double fraction(void) {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t s[4];
+};
+
+// Derives the seed for one of several independent random streams
+// from a single user-supplied seed.  Two generators seeded with the
+// same value produce the same sequence, so a benchmark that draws keys
+// from a key_distribution and operation types from its own
+// random_generator must not seed both with the same number.  Nor may
+// it use seed + k: reseed() walks seed, seed + golden, ..., so nearby
+// seeds share state words.  The result is run through the splitmix64
+// finalizer, which makes streams for different indices unrelated.
+static inline uint64_t stream_seed(uint64_t seed, uint64_t stream)
+{
+  uint64_t z = seed + (stream + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// FNV-1a, used to scatter zipfian ranks so that the popular keys are
+// not all adjacent in key order.
+static inline uint64_t fnv_hash(uint64_t x)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (int i = 0; i < 8; i++) {
+    h ^= x & 0xff;
+    h *= 1099511628211ULL;
+    x >>= 8;
+  }
+  return h;
+}
+
+// Zipfian ranks in [0, n), following Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases".  n may grow between
+// calls, in which case zeta(n) is extended incrementally.
+class zipfian_generator {
+public:
+  zipfian_generator(double theta)
+    : theta(theta),
+      n(0),
+      zetan(0)
+  {
+    zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    alpha = 1.0 / (1.0 - theta);
+  }
+
+  uint64_t next(random_generator &rng, uint64_t items) {
+    if (items > n)
+      grow(items);
+    double u = rng.fraction();
+    double uz = u * zetan;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + pow(0.5, theta))
+      return 1;
+    uint64_t r = n * pow(eta * u - eta + 1.0, alpha);
+    return r < n ? r : n - 1;
+  }
+
+private:
+  void grow(uint64_t items) {
+    for (uint64_t i = n; i < items; i++)
+      zetan += 1.0 / pow(i + 1, theta);
+    n = items;
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+  }
+
+  double theta;
+  uint64_t n;
+  double zetan;
+  double zeta2;
+  double alpha;
+  double eta;
+};
+
+class key_distribution {
+public:
+  key_distribution(uint64_t seed)
+    : rng(seed)
+  {}
+
+  virtual ~key_distribution(void) {}
+
+  // Return a key in [0, n).  Requires n > 0.
+  virtual uint64_t next(uint64_t n) = 0;
+
+  // Restart the sequence of keys from the beginning.
+  virtual void reset(uint64_t seed) {
+    rng.reseed(seed);
+  }
+
+protected:
+  random_generator rng;
+};
+
+class uniform_distribution : public key_distribution {
+public:
+  uniform_distribution(uint64_t seed)
+    : key_distribution(seed)
+  {}
+
+  uint64_t next(uint64_t n) {
+    return rng.uniform(n);
+  }
+};
+
+class zipfian_distribution : public key_distribution {
+public:
+  zipfian_distribution(uint64_t seed, double theta)
+    : key_distribution(seed),
+      zipf(theta)
+  {}
+
+  uint64_t next(uint64_t n) {
+    return fnv_hash(zipf.next(rng, n)) % n;
+  }
+
+private:
+  zipfian_generator zipf;
+};
+
+class latest_distribution : public key_distribution {
+public:
+  latest_distribution(uint64_t seed, double theta)
+    : key_distribution(seed),
+      zipf(theta)
+  {}
+
+  uint64_t next(uint64_t n) {
+    return n - 1 - zipf.next(rng, n);
+  }
+
+private:
+  zipfian_generator zipf;
+};
+
+class sequential_distribution : public key_distribution {
+public:
+  sequential_distribution(uint64_t seed, bool reverse)
+    : key_distribution(seed),
+      reverse(reverse),
+      counter(0)
+  {}
+
+  uint64_t next(uint64_t n) {
+    uint64_t k = counter++ % n;
+    return reverse ? n - 1 - k : k;
+  }
+
+  void reset(uint64_t seed) {
+    key_distribution::reset(seed);
+    counter = 0;
+  }
+
+private:
+  bool reverse;
+  uint64_t counter;
+};
+
+class hotspot_distribution : public key_distribution {
+public:
+  hotspot_distribution(uint64_t seed)
+    : key_distribution(seed)
+  {}
+
+  uint64_t next(uint64_t n) {
+    uint64_t hot = n * HOTSPOT_KEY_FRACTION;
+    if (hot == 0 || hot == n)
+      return rng.uniform(n);
+    if (rng.fraction() < HOTSPOT_OPERATION_FRACTION)
+      return rng.uniform(hot);
+    return hot + rng.uniform(n - hot);
+  }
+};
+
+// Returns NULL if name is not one of the distributions listed above.
+// The caller owns the returned object.
+static inline key_distribution * make_key_distribution(const char *name,
+						       double theta,
+						       uint64_t seed)
+{
+  if (strcmp(name, "uniform") == 0)
+    return new uniform_distribution(seed);
+  else if (strcmp(name, "zipfian") == 0)
+    return new zipfian_distribution(seed, theta);
+  else if (strcmp(name, "sequential") == 0)
+    return new sequential_distribution(seed, false);
+  else if (strcmp(name, "reverse-sequential") == 0)
+    return new sequential_distribution(seed, true);
+  else if (strcmp(name, "latest") == 0)
+    return new latest_distribution(seed, theta);
+  else if (strcmp(name, "hotspot") == 0)
+    return new hotspot_distribution(seed);
+  return NULL;
+}
+
+#endif // KEY_DISTRIBUTION_HPP
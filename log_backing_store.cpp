@@ -0,0 +1,359 @@
+#include "log_backing_store.hpp"
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cassert>
+
+log_backing_store::statistics::statistics(void)
+  : segments(0),
+    disk_bytes(0),
+    live_bytes(0),
+    bytes_appended(0),
+    segments_sealed(0),
+    segments_freed(0),
+    segments_cleaned(0),
+    bytes_relocated(0)
+{}
+
+log_backing_store::log_backing_store(std::string rt,
+				     durability d,
+				     uint64_t segsize,
+				     double threshold,
+				     bool background_cleaner)
+  : root(rt),
+    mode(d),
+    segment_size(segsize),
+    cleaning_threshold(threshold),
+    nextid(1),
+    next_segment(1),
+    head(0),
+    syncs(0),
+    directory_dirty(false),
+    tail_offset(0),
+    stopping(false)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  start_segment();
+  if (background_cleaner)
+    cleaner = std::thread(&log_backing_store::cleaner_main, this);
+}
+
+log_backing_store::~log_backing_store(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  cleaner_wakeup.notify_one();
+  if (cleaner.joinable())
+    cleaner.join();
+
+  std::lock_guard<std::mutex> guard(lock);
+  flush_tail();
+  for (auto it = segments.begin(); it != segments.end(); ) {
+    uint64_t seg = (it++)->first;
+    if (segments[seg].live == 0)
+      remove_segment(seg);
+    else
+      close(segments[seg].fd);
+  }
+}
+
+std::string log_backing_store::segment_filename(uint64_t seg) const
+{
+  return root + "/segment-" + std::to_string(seg);
+}
+
+// Seal the head segment, if any, and start a new one.
+void log_backing_store::start_segment(void)
+{
+  if (head) {
+    flush_tail();
+    segment &old = segments[head];
+    if (old.live == 0) {
+      remove_segment(head);
+      counters.segments_freed++;
+    } else {
+      counters.segments_sealed++;
+      if (old.live < cleaning_threshold * old.size)
+	cleaner_wakeup.notify_one();
+    }
+  }
+  uint64_t seg = next_segment++;
+  segment &s = segments[seg];
+  s.fd = open(segment_filename(seg).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(s.fd >= 0);
+  s.size = 0;
+  s.live = 0;
+  s.dirty = false;
+  head = seg;
+  tail_offset = 0;
+  directory_dirty = true;
+}
+
+void log_backing_store::append(uint64_t id, const char *data, size_t n)
+{
+  if (segments[head].size > 0 &&
+      segments[head].size + n > segment_size)
+    start_segment();
+  segment &s = segments[head];
+  location &loc = locations[id];
+  loc.segment = head;
+  loc.offset = s.size;
+  loc.length = n;
+  s.size += n;
+  s.live += n;
+  s.objects.insert(id);
+  tail.append(data, n);
+  if (tail.size() >= LOG_WRITE_BUFFER_SIZE)
+    flush_tail();
+}
+
+std::string log_backing_store::read(const location &loc)
+{
+  if (loc.segment == head && loc.offset >= tail_offset)
+    return tail.substr(loc.offset - tail_offset, loc.length);
+  std::string data(loc.length, '\0');
+  int fd = segments[loc.segment].fd;
+  for (uint64_t done = 0; done < loc.length; ) {
+    ssize_t r = pread(fd, &data[done], loc.length - done, loc.offset + done);
+    assert(r > 0);
+    done += r;
+  }
+  return data;
+}
+
+// Drop object id from its segment's accounting.
+void log_backing_store::release(uint64_t id)
+{
+  location &loc = locations[id];
+  segment &s = segments[loc.segment];
+  s.live -= loc.length;
+  s.objects.erase(id);
+}
+
+void log_backing_store::remove_segment(uint64_t seg)
+{
+  close(segments[seg].fd);
+  int r = unlink(segment_filename(seg).c_str());
+  assert(r == 0);
+  (void)r;
+  segments.erase(seg);
+  directory_dirty = true;
+}
+
+void log_backing_store::flush_tail(void)
+{
+  if (tail.empty())
+    return;
+  int fd = segments[head].fd;
+  for (uint64_t done = 0; done < tail.size(); ) {
+    ssize_t r = pwrite(fd, tail.data() + done, tail.size() - done,
+		       tail_offset + done);
+    assert(r > 0);
+    done += r;
+  }
+  tail_offset += tail.size();
+  tail.clear();
+  segments[head].dirty = true;
+}
+
+void log_backing_store::sync_locked(void)
+{
+  flush_tail();
+  for (auto it = segments.begin(); it != segments.end(); ++it) {
+    if (it->second.dirty) {
+      fdatasync(it->second.fd);
+      it->second.dirty = false;
+      syncs++;
+    }
+  }
+  if (directory_dirty) {
+    int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+    assert(fd >= 0);
+    fsync(fd);
+    close(fd);
+    directory_dirty = false;
+    syncs++;
+  }
+}
+
+// The sealed segment with the lowest live fraction, if that is below
+// the cleaning threshold.
+bool log_backing_store::find_victim(uint64_t &seg) const
+{
+  double best = cleaning_threshold;
+  bool found = false;
+  for (auto it = segments.begin(); it != segments.end(); ++it) {
+    if (it->first == head || it->second.size == 0)
+      continue;
+    double live_fraction = (double)it->second.live / it->second.size;
+    if (live_fraction < best) {
+      best = live_fraction;
+      seg = it->first;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Relocate the live objects of seg one at a time, dropping the lock
+// in between so that the swap_space is never stalled for long.  The
+// relocated copies are made durable before the segment is deleted.
+void log_backing_store::clean_segment(std::unique_lock<std::mutex> &guard,
+				      uint64_t seg)
+{
+  while (!stopping && segments.count(seg) && !segments[seg].objects.empty()) {
+    uint64_t id = *segments[seg].objects.begin();
+    std::string data = read(locations[id]);
+    release(id);
+    append(id, data.data(), data.size());
+    counters.bytes_relocated += data.size();
+    guard.unlock();
+    guard.lock();
+  }
+  if (stopping || segments.count(seg) == 0)
+    return;
+  if (mode != DURABILITY_NONE)
+    sync_locked();
+  remove_segment(seg);
+  counters.segments_cleaned++;
+}
+
+void log_backing_store::cleaner_main(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    uint64_t seg;
+    if (find_victim(seg))
+      clean_segment(guard, seg);
+    else
+      cleaner_wakeup.wait(guard);
+  }
+}
+
+void log_backing_store::clean(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  uint64_t seg;
+  while (find_victim(seg))
+    clean_segment(guard, seg);
+}
+
+uint64_t log_backing_store::allocate(size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  uint64_t id = nextid++;
+  unwritten.insert(id);
+  return id;
+}
+
+void log_backing_store::deallocate(uint64_t id)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (unwritten.erase(id))
+    return;
+  assert(locations.count(id) > 0);
+  uint64_t seg = locations[id].segment;
+  release(id);
+  locations.erase(id);
+  if (seg == head)
+    return;
+  segment &s = segments[seg];
+  if (s.objects.empty()) {
+    remove_segment(seg);
+    counters.segments_freed++;
+  } else if (s.live < cleaning_threshold * s.size) {
+    cleaner_wakeup.notify_one();
+  }
+}
+
+std::iostream * log_backing_store::get(uint64_t id)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  std::stringstream *ios;
+  if (unwritten.erase(id)) {
+    ios = new std::stringstream;
+    writes[ios] = id;
+  } else {
+    assert(locations.count(id) > 0);
+    ios = new std::stringstream(read(locations[id]));
+  }
+  ios->exceptions(std::ios::badbit | std::ios::failbit | std::ios::eofbit);
+  return ios;
+}
+
+// The one write of a newly allocated object.
+void log_backing_store::store(uint64_t id, const char *data, size_t n)
+{
+  append(id, data, n);
+  counters.bytes_appended += n;
+  if (mode == DURABILITY_FULL)
+    sync_locked();
+}
+
+void log_backing_store::put(std::iostream *ios)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = writes.find(ios);
+  if (it != writes.end()) {
+    std::string data = ((std::stringstream *)ios)->str();
+    store(it->second, data.data(), data.size());
+    writes.erase(it);
+  }
+  delete ios;
+}
+
+void log_backing_store::read(uint64_t id, buffer_stream &buf)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  assert(locations.count(id) > 0);
+  const location &loc = locations[id];
+  if (loc.segment == head && loc.offset >= tail_offset) {
+    memcpy(buf.start_read(loc.length),
+	   tail.data() + (loc.offset - tail_offset), loc.length);
+    return;
+  }
+  char *p = buf.start_read(loc.length);
+  int fd = segments[loc.segment].fd;
+  for (uint64_t done = 0; done < loc.length; ) {
+    ssize_t r = pread(fd, p + done, loc.length - done, loc.offset + done);
+    assert(r > 0);
+    done += r;
+  }
+}
+
+void log_backing_store::write(uint64_t id, const char *data, size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  store(id, data, n);
+}
+
+void log_backing_store::sync(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (mode == DURABILITY_ORDERED)
+    sync_locked();
+}
+
+uint64_t log_backing_store::get_number_of_syncs(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return syncs;
+}
+
+log_backing_store::statistics log_backing_store::stats(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  statistics result = counters;
+  result.segments = segments.size();
+  for (auto it = segments.begin(); it != segments.end(); ++it) {
+    result.disk_bytes += it->second.size;
+    result.live_bytes += it->second.live;
+  }
+  return result;
+}
@@ -0,0 +1,129 @@
+// A log-structured backing_store.
+
+// Every object written is appended to the current segment, a large
+// file in the store's directory, so the device sees only large
+// sequential writes no matter how the swap_space's write-backs are
+// sized and timed.  Appends are buffered in memory and written
+// LOG_WRITE_BUFFER_SIZE bytes at a time.  An in-memory map takes each
+// object id to its (segment, offset, length).  The map is not
+// persisted, so, like the other stores, this one cannot be reopened.
+
+// When the current segment reaches the segment size, it is sealed and
+// a new one is started.  Deallocating an object only reduces its
+// segment's live byte count.  A sealed segment with no live bytes
+// left is deleted.  A cleaner compacts sealed segments whose live
+// fraction falls below the cleaning threshold, by re-appending their
+// live objects to the current segment and then deleting them.  The
+// cleaner runs in a background thread, or, if the store is created
+// without one, whenever clean() is called.
+
+// Objects are never overwritten in place.
+
+#ifndef LOG_BACKING_STORE_HPP
+#define LOG_BACKING_STORE_HPP
+
+#include "backing_store.hpp"
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define LOG_SEGMENT_SIZE (4ULL << 20)
+#define LOG_WRITE_BUFFER_SIZE (1ULL << 20)
+#define LOG_CLEANING_THRESHOLD (0.5)
+
+class log_backing_store: public backing_store {
+public:
+  class statistics {
+  public:
+    statistics(void);
+
+    uint64_t segments;		// currently on disk, including the head
+    uint64_t disk_bytes;	// total size of those segments
+    uint64_t live_bytes;
+    uint64_t bytes_appended;	// by put(), not counting relocations
+    uint64_t segments_sealed;
+    uint64_t segments_freed;	// deleted because they had no live data
+    uint64_t segments_cleaned;	// deleted after relocating their live data
+    uint64_t bytes_relocated;	// by the cleaner
+  };
+
+  log_backing_store(std::string root,
+		    durability d = DURABILITY_FULL,
+		    uint64_t segment_size = LOG_SEGMENT_SIZE,
+		    double cleaning_threshold = LOG_CLEANING_THRESHOLD,
+		    bool background_cleaner = true);
+  ~log_backing_store(void);
+
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
+
+  // Clean every sealed segment below the cleaning threshold.
+  void clean(void);
+  statistics stats(void) const;
+
+private:
+  class segment {
+  public:
+    int fd;
+    uint64_t size;
+    uint64_t live;
+    bool dirty;			// written since the last sync
+    std::unordered_set<uint64_t> objects;
+  };
+
+  class location {
+  public:
+    uint64_t segment;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  // All of the following require the lock to be held.
+  std::string segment_filename(uint64_t seg) const;
+  void start_segment(void);
+  void append(uint64_t id, const char *data, size_t n);
+  void store(uint64_t id, const char *data, size_t n);
+  std::string read(const location &loc);
+  void release(uint64_t id);
+  void remove_segment(uint64_t seg);
+  void flush_tail(void);
+  void sync_locked(void);
+  bool find_victim(uint64_t &seg) const;
+  void clean_segment(std::unique_lock<std::mutex> &guard, uint64_t seg);
+
+  void cleaner_main(void);
+
+  std::string	root;
+  durability	mode;
+  uint64_t	segment_size;
+  double	cleaning_threshold;
+  uint64_t	nextid;
+  uint64_t	next_segment;
+  uint64_t	head;
+  uint64_t	syncs;
+  bool		directory_dirty;
+  // The part of the head segment not yet written to its file, and the
+  // file offset at which it starts.
+  std::string	tail;
+  uint64_t	tail_offset;
+
+  std::map<uint64_t, segment> segments;
+  std::unordered_map<uint64_t, location> locations;
+  std::unordered_set<uint64_t> unwritten;
+  std::unordered_map<std::iostream *, uint64_t> writes;
+  statistics	counters;
+
+  mutable std::mutex lock;
+  std::condition_variable cleaner_wakeup;
+  bool		stopping;
+  std::thread	cleaner;
+};
+
+#endif // LOG_BACKING_STORE_HPP
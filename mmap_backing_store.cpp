@@ -0,0 +1,220 @@
+#include "mmap_backing_store.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+mmap_backing_store::mmap_backing_store(std::string root, durability d)
+  : filename(root + "/objects"),
+    mode(d),
+    fd(-1),
+    map(NULL),
+    file_size(0),
+    space(MMAP_STORE_BLOCK_SIZE),
+    nextid(1),
+    syncs(0),
+    unsynced(false),
+    sequential(false)
+{
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  grow(MMAP_STORE_INITIAL_SIZE);
+}
+
+mmap_backing_store::~mmap_backing_store(void)
+{
+  munmap(map, file_size);
+  close(fd);
+  if (extents.empty())
+    unlink(filename.c_str());
+}
+
+// Extend the file and its mapping to at least size bytes.
+void mmap_backing_store::grow(uint64_t size)
+{
+  uint64_t new_size = file_size ? file_size : size;
+  while (new_size < size)
+    new_size *= 2;
+  // The mapping must never extend past the end of the file, or
+  // reading it would raise SIGBUS, and the store cannot go on without
+  // the space.
+  if (ftruncate(fd, new_size) != 0) {
+    perror("Couldn't grow mmap store");
+    abort();
+  }
+  void *p;
+  if (map == NULL)
+    p = mmap(NULL, new_size, PROT_READ, MAP_SHARED, fd, 0);
+  else
+    p = mremap(map, file_size, new_size, MREMAP_MAYMOVE);
+  assert(p != MAP_FAILED);
+  map = (char *)p;
+  file_size = new_size;
+  advise();
+}
+
+// Halve the file and its mapping while the objects fit in a quarter
+// of it.
+void mmap_backing_store::shrink(void)
+{
+  uint64_t new_size = file_size;
+  while (new_size > MMAP_STORE_INITIAL_SIZE && space.size() <= new_size / 4)
+    new_size /= 2;
+  // If the file cannot be shortened, just keep it and the mapping
+  // at their current size.
+  if (new_size == file_size || ftruncate(fd, new_size) != 0)
+    return;
+  void *p = mremap(map, file_size, new_size, MREMAP_MAYMOVE);
+  assert(p != MAP_FAILED);
+  map = (char *)p;
+  file_size = new_size;
+}
+
+// Move up to FREE_SPACE_DEFRAG_STEP of the highest-addressed objects
+// into free space lower in the file.
+void mmap_backing_store::defragment(void)
+{
+  for (int i = 0; i < FREE_SPACE_DEFRAG_STEP && space.should_defragment(); i++) {
+    auto last = owners.rbegin();
+    if (last == owners.rend() || unwritten.count(last->second))
+      break;
+    uint64_t id = last->second;
+    extent &e = extents[id];
+    uint64_t offset = space.allocate(e.capacity);
+    if (offset > e.offset) {
+      space.free(offset, e.capacity);
+      break;
+    }
+    for (uint64_t done = 0; done < e.length; ) {
+      ssize_t r = pwrite(fd, map + e.offset + done, e.length - done, offset + done);
+      assert(r > 0);
+      done += r;
+    }
+    owners.erase(e.offset);
+    space.free(e.offset, e.capacity);
+    e.offset = offset;
+    owners[offset] = id;
+    space.count_relocation();
+    if (mode == DURABILITY_FULL) {
+      fdatasync(fd);
+      syncs++;
+    } else if (mode == DURABILITY_ORDERED) {
+      unsynced = true;
+    }
+  }
+}
+
+void mmap_backing_store::advise(void)
+{
+  madvise(map, file_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
+
+void mmap_backing_store::set_sequential(bool s)
+{
+  sequential = s;
+  advise();
+}
+
+uint64_t mmap_backing_store::allocate(size_t n)
+{
+  uint64_t id = nextid++;
+  extent &e = extents[id];
+  e.offset = space.allocate(n);
+  e.length = n;
+  e.capacity = space.round_up(n);
+  if (space.size() > file_size)
+    grow(space.size());
+  owners[e.offset] = id;
+  unwritten.insert(id);
+  return id;
+}
+
+void mmap_backing_store::deallocate(uint64_t id)
+{
+  assert(extents.count(id) > 0);
+  extent &e = extents[id];
+  space.free(e.offset, e.capacity);
+  owners.erase(e.offset);
+  extents.erase(id);
+  unwritten.erase(id);
+  defragment();
+  shrink();
+}
+
+bool mmap_backing_store::overwrite(uint64_t id, size_t n)
+{
+  assert(extents.count(id) > 0);
+  extent &e = extents[id];
+  if (n > e.capacity)
+    return false;
+  e.length = n;
+  unwritten.insert(id);
+  return true;
+}
+
+void mmap_backing_store::read(uint64_t id, buffer_stream &buf)
+{
+  assert(extents.count(id) > 0);
+  const extent &e = extents[id];
+  buf.borrow(map + e.offset, e.length);
+}
+
+void mmap_backing_store::write(uint64_t id, const char *data, size_t n)
+{
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  extent &e = extents[id];
+  assert(n <= e.capacity);
+  e.length = n;
+  for (size_t done = 0; done < n; ) {
+    ssize_t r = pwrite(fd, data + done, n - done, e.offset + done);
+    assert(r > 0);
+    done += r;
+  }
+  if (mode == DURABILITY_FULL) {
+    fdatasync(fd);
+    syncs++;
+  } else if (mode == DURABILITY_ORDERED) {
+    unsynced = true;
+  }
+}
+
+std::iostream * mmap_backing_store::get(uint64_t id)
+{
+  buffer_stream *bs = new buffer_stream;
+  if (unwritten.count(id)) {
+    bs->start_write();
+    writes[bs] = id;
+  } else {
+    read(id, *bs);
+  }
+  return bs;
+}
+
+void mmap_backing_store::put(std::iostream *ios)
+{
+  buffer_stream *bs = (buffer_stream *)ios;
+  auto it = writes.find(ios);
+  if (it != writes.end()) {
+    write(it->second, bs->data(), bs->written());
+    writes.erase(it);
+  }
+  delete bs;
+}
+
+void mmap_backing_store::sync(void)
+{
+  if (mode != DURABILITY_ORDERED || !unsynced)
+    return;
+  fdatasync(fd);
+  syncs++;
+  unsynced = false;
+}
+
+uint64_t mmap_backing_store::get_number_of_syncs(void) const
+{
+  return syncs;
+}
@@ -0,0 +1,85 @@
+// A backing_store that serves reads from a read-only memory mapping.
+
+// All objects live in a single file, "objects", in the store's
+// directory.  Each object gets an extent of the file when it is
+// allocated, and is written there with pwrite().  The whole file is
+// mapped read-only, and read() hands the deserializer the object's
+// bytes in the mapping itself (see buffer_stream::borrow()), so a
+// load of a node that is in the page cache costs no system call and
+// no copy.
+
+// The file grows by doubling, and the mapping is moved along with it
+// (mremap()), so memory borrowed from a read() is valid only until
+// the next allocation or deallocation.  swap_space finishes parsing
+// each load before it does either.
+
+// The mapping is advised MADV_RANDOM, which suits node loads, unless
+// set_sequential() asks for MADV_SEQUENTIAL, e.g. for long scans.
+
+// Extents are MMAP_STORE_BLOCK_SIZE-aligned and managed by a
+// free_space_manager, which reuses freed space.  Deallocations
+// defragment the file incrementally, and the file and the mapping
+// shrink by halves when the objects fit in a quarter of them.  An
+// overwrite in place is allowed when the new image fits in the
+// object's extent.  The extent map is not persisted, so, like the
+// other stores, this one cannot be reopened.
+
+#ifndef MMAP_BACKING_STORE_HPP
+#define MMAP_BACKING_STORE_HPP
+
+#include "backing_store.hpp"
+#include "free_space_manager.hpp"
+#include <map>
+
+#define MMAP_STORE_INITIAL_SIZE (16ULL << 20)
+#define MMAP_STORE_BLOCK_SIZE (64)
+
+class mmap_backing_store: public backing_store {
+public:
+  mmap_backing_store(std::string root, durability d = DURABILITY_FULL);
+  ~mmap_backing_store(void);
+
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
+
+  void set_sequential(bool sequential);
+  uint64_t get_file_size(void) const { return file_size; }
+  free_space_manager::statistics free_space_stats(void) const { return space.stats(); }
+
+private:
+  class extent {
+  public:
+    uint64_t offset;
+    uint64_t length;		// of the object's current image
+    uint64_t capacity;		// of the extent
+  };
+
+  void grow(uint64_t size);
+  void shrink(void);
+  void advise(void);
+  void defragment(void);
+
+  std::string	filename;
+  durability	mode;
+  int		fd;
+  char *	map;
+  uint64_t	file_size;
+  free_space_manager space;
+  uint64_t	nextid;
+  uint64_t	syncs;
+  bool		unsynced;
+  bool		sequential;
+  std::unordered_map<uint64_t, extent> extents;
+  std::map<uint64_t, uint64_t> owners;	// extent offset -> object id
+  std::unordered_set<uint64_t> unwritten;
+  std::unordered_map<std::iostream *, uint64_t> writes;
+};
+
+#endif // MMAP_BACKING_STORE_HPP
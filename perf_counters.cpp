@@ -0,0 +1,108 @@
+#include "perf_counters.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[perf_counters::NUM_EVENTS] = {
+  { "cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { "branch-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { "page-faults",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+  { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+static int open_event(uint32_t type, uint64_t config, bool exclude_kernel)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+perf_counters::values::values(void)
+{
+  memset(counts, 0, sizeof(counts));
+}
+
+perf_counters::values perf_counters::values::operator-(const values &other) const
+{
+  values result;
+  for (int i = 0; i < NUM_EVENTS; i++)
+    result.counts[i] = counts[i] - other.counts[i];
+  return result;
+}
+
+perf_counters::perf_counters(void)
+{
+  for (int i = 0; i < NUM_EVENTS; i++)
+    fds[i] = -1;
+}
+
+perf_counters::~perf_counters(void)
+{
+  for (int i = 0; i < NUM_EVENTS; i++)
+    if (fds[i] >= 0)
+      close(fds[i]);
+}
+
+int perf_counters::open(void)
+{
+  int opened = 0;
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    // Counting kernel mode needs perf_event_paranoid <= 1, so fall
+    // back to user mode only.
+    fds[i] = open_event(events[i].type, events[i].config, false);
+    if (fds[i] < 0)
+      fds[i] = open_event(events[i].type, events[i].config, true);
+    if (fds[i] >= 0) {
+      ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+      opened++;
+    }
+  }
+  return opened;
+}
+
+perf_counters::values perf_counters::read(void) const
+{
+  values result;
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    uint64_t buf[3];
+    if (fds[i] < 0 || ::read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+      continue;
+    // buf[0] is the count, buf[1] the time enabled, buf[2] the time
+    // running.
+    if (buf[2] > 0 && buf[2] < buf[1])
+      result.counts[i] = (double)buf[0] * buf[1] / buf[2];
+    else
+      result.counts[i] = buf[0];
+  }
+  return result;
+}
+
+void perf_counters::print(const char *phase, const values &v) const
+{
+  std::string line;
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    line += std::string(" ") + events[i].name + " ";
+    line += fds[i] >= 0 ? std::to_string(v.counts[i]) : "n/a";
+  }
+  printf("# %s perf:%s", phase, line.c_str());
+  if (fds[CYCLES] >= 0 && fds[INSTRUCTIONS] >= 0 && v.counts[CYCLES])
+    printf(" IPC %.2f", (double)v.counts[INSTRUCTIONS] / v.counts[CYCLES]);
+  printf("\n");
+}
@@ -0,0 +1,57 @@
+// Hardware and software performance counters for the benchmarks,
+// read through perf_event_open(2).
+
+// The counters count only the calling thread (user and, where
+// permitted, kernel mode), from open() until the perf_counters
+// object is destroyed.  Benchmarks take a snapshot with read() at
+// the start and end of each phase and report the difference.
+
+// Each counter is opened separately, so that a counter the machine
+// or the kernel does not support (e.g. hardware counters in most
+// virtual machines, or anything when perf_event_paranoid forbids it)
+// is simply reported as unavailable while the others still work.
+// If the kernel multiplexes counters, values are scaled by the
+// fraction of the time the counter was actually running.
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+
+class perf_counters {
+public:
+  enum event {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,		// usually last-level cache misses
+    BRANCH_MISSES,
+    PAGE_FAULTS,
+    CONTEXT_SWITCHES,
+    NUM_EVENTS
+  };
+
+  class values {
+  public:
+    values(void);
+    values operator-(const values &other) const;
+
+    uint64_t counts[NUM_EVENTS];
+  };
+
+  perf_counters(void);
+  ~perf_counters(void);
+
+  // Returns the number of counters that could be opened.
+  int open(void);
+  bool is_available(event e) const { return fds[e] >= 0; }
+  values read(void) const;
+
+  // Print one line of the available counters, plus IPC if both
+  // cycles and instructions are available.
+  void print(const char *phase, const values &v) const;
+
+private:
+  int fds[NUM_EVENTS];
+};
+
+#endif // PERF_COUNTERS_HPP
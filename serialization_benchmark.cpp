@@ -0,0 +1,312 @@
+// Microbenchmarks for the serialization code that swap_space uses to
+// write back and load objects.
+
+// Each benchmark times serialize() and deserialize() through a
+// serialization_context and a pair of reused buffer_streams, exactly
+// as swap_space::write_back() and swap_space::load() do: serializing
+// appends to a growable buffer after start_write(), and deserializing
+// parses that buffer in place through borrow().  It reports
+// throughput in MB/s of serialized data and time per message (or per
+// map entry or string).  The benchmarks are
+//   leaf       a betree leaf holding -n messages
+//   internal   a betree internal node with -F children and -n
+//              buffered messages
+//   map        a std::map with -n entries
+//   string     a std::string of -v bytes
+// Keys and values are either uint64_t or std::string (-K and -V).
+
+#include <string.h>
+#include <unistd.h>
+#include "betree.hpp"
+#include "histogram.hpp"
+#include "key_distribution.hpp"
+
+#define DEFAULT_NODE_MESSAGES (1024)
+#define DEFAULT_FANOUT (16)
+#define DEFAULT_KEY_SIZE (16)
+#define DEFAULT_VALUE_SIZE (100)
+#define DEFAULT_ITERATIONS (100)
+
+struct benchmark_options {
+  uint64_t messages;
+  uint64_t fanout;
+  uint64_t key_size;
+  uint64_t value_size;
+  uint64_t iterations;
+  uint64_t random_seed;
+};
+
+template<class T> T make_item(random_generator &rng, uint64_t size);
+
+template<> uint64_t make_item<uint64_t>(random_generator &rng, uint64_t size)
+{
+  return rng.next();
+}
+
+template<> std::string make_item<std::string>(random_generator &rng, uint64_t size)
+{
+  std::string s(size, ' ');
+  for (uint64_t i = 0; i < size; i++)
+    s[i] = 'a' + rng.uniform(26);
+  return s;
+}
+
+// Accumulates the time and bytes of one direction of one benchmark.
+class measurement {
+public:
+  measurement(void)
+    : time_ns(0),
+      bytes(0),
+      items(0)
+  {}
+
+  void add(uint64_t t, uint64_t b, uint64_t n) {
+    time_ns += t;
+    bytes += b;
+    items += n;
+  }
+
+  void print(const char *name, const char *op, const char *unit) const {
+    printf("# %s %s: %.1f MB/s, %.1f ns/%s, %.1f bytes/%s\n",
+	   name, op,
+	   time_ns ? 1e3 * bytes / time_ns : 0.0,
+	   items ? (double)time_ns / items : 0.0, unit,
+	   items ? (double)bytes / items : 0.0, unit);
+  }
+
+  uint64_t time_ns;
+  uint64_t bytes;
+  uint64_t items;
+};
+
+// Serialize x into out, then deserialize the result into y through
+// in, timing each half.  Returns the serialized size.
+template<class X>
+uint64_t round_trip(swap_space &sspace, buffer_stream &out, buffer_stream &in,
+		    X &x, X &y, uint64_t &serialize_ns, uint64_t &deserialize_ns)
+{
+  serialization_context out_context(sspace);
+  uint64_t start = now_ns();
+  out.start_write();
+  serialize(out, out_context, x);
+  serialize_ns = now_ns() - start;
+  uint64_t size = out.written();
+
+  in.borrow(out.data(), size);
+  serialization_context in_context(sspace);
+  start = now_ns();
+  deserialize(in, in_context, y);
+  deserialize_ns = now_ns() - start;
+  return size;
+}
+
+template<class K, class V> class serialization_benchmark {
+public:
+  typedef betree<K, V> tree;
+  typedef typename tree::node node;
+  typedef typename tree::child_info child_info;
+
+  serialization_benchmark(const benchmark_options &opts)
+    : opts(opts),
+      rng(opts.random_seed),
+      sspace(&store, 2 * opts.fanout + 2)
+  {}
+
+  void run(void) {
+    bench_node("leaf", 0);
+    bench_node("internal", opts.fanout);
+    bench_map();
+    bench_string();
+  }
+
+private:
+  node * make_node(uint64_t fanout) {
+    node *n = new node;
+    std::vector<K> pivots;
+    for (uint64_t i = 0; i < fanout; i++)
+      pivots.push_back(make_item<K>(rng, opts.key_size));
+    std::sort(pivots.begin(), pivots.end());
+    for (uint64_t i = 0; i < fanout; i++)
+      n->pivots[pivots[i]] = child_info(sspace.allocate(new node), 0);
+    for (uint64_t i = 0; i < opts.messages; i++)
+      n->elements[MessageKey<K>(make_item<K>(rng, opts.key_size), i + 1)] =
+	Message<V>(INSERT, make_item<V>(rng, opts.value_size));
+    return n;
+  }
+
+  // Serializing a node hands its child references over to the
+  // serialized image, and deserializing takes them back, so each
+  // iteration round-trips the node produced by the previous one,
+  // just as repeated evictions and loads would.
+  void bench_node(const char *name, uint64_t fanout) {
+    measurement ser, deser;
+    node *current = make_node(fanout);
+    for (uint64_t i = 0; i < opts.iterations; i++) {
+      node *next = new node;
+      uint64_t sns, dns;
+      uint64_t size = round_trip(sspace, out, in, *current, *next, sns, dns);
+      ser.add(sns, size, opts.messages);
+      deser.add(dns, size, opts.messages);
+      delete current;
+      current = next;
+    }
+    delete current;
+    ser.print(name, "serialize", "message");
+    deser.print(name, "deserialize", "message");
+  }
+
+  void bench_map(void) {
+    measurement ser, deser;
+    std::map<K, V> m;
+    while (m.size() < opts.messages)
+      m[make_item<K>(rng, opts.key_size)] = make_item<V>(rng, opts.value_size);
+    for (uint64_t i = 0; i < opts.iterations; i++) {
+      std::map<K, V> copy;
+      uint64_t sns, dns;
+      uint64_t size = round_trip(sspace, out, in, m, copy, sns, dns);
+      assert(copy == m);
+      ser.add(sns, size, m.size());
+      deser.add(dns, size, m.size());
+    }
+    ser.print("map", "serialize", "entry");
+    deser.print("map", "deserialize", "entry");
+  }
+
+  void bench_string(void) {
+    measurement ser, deser;
+    std::string s = make_item<std::string>(rng, opts.value_size);
+    // A single string is too quick to time, so time a batch.
+    const uint64_t batch = 1000;
+    for (uint64_t i = 0; i < opts.iterations; i++) {
+      serialization_context out_context(sspace);
+      uint64_t start = now_ns();
+      out.start_write();
+      for (uint64_t j = 0; j < batch; j++)
+	serialize(out, out_context, s);
+      uint64_t sns = now_ns() - start;
+      uint64_t size = out.written();
+
+      in.borrow(out.data(), size);
+      serialization_context in_context(sspace);
+      std::string copy;
+      start = now_ns();
+      for (uint64_t j = 0; j < batch; j++)
+	deserialize(in, in_context, copy);
+      uint64_t dns = now_ns() - start;
+      assert(copy == s);
+      ser.add(sns, size, batch);
+      deser.add(dns, size, batch);
+    }
+    ser.print("string", "serialize", "string");
+    deser.print("string", "deserialize", "string");
+  }
+
+  benchmark_options opts;
+  random_generator rng;
+  in_memory_backing_store store;
+  swap_space sspace;
+  buffer_stream out, in;
+};
+
+void usage(char *name)
+{
+  std::cout
+    << "Usage: " << name << " [OPTIONS]" << std::endl
+    << "Benchmarks serialization of betree nodes, maps and strings" << std::endl
+    << std::endl
+    << "Options are" << std::endl
+    << "    -n <messages>                 (per node and map) [ default: " << DEFAULT_NODE_MESSAGES << " ]" << std::endl
+    << "    -F <fanout>                   (internal nodes)   [ default: " << DEFAULT_FANOUT        << " ]" << std::endl
+    << "    -K <key_type>                 (uint64 or string) [ default: uint64 ]"                          << std::endl
+    << "    -k <key_size>                 (in bytes, string) [ default: " << DEFAULT_KEY_SIZE      << " ]" << std::endl
+    << "    -V <value_type>               (uint64 or string) [ default: string ]"                          << std::endl
+    << "    -v <value_size>               (in bytes, string) [ default: " << DEFAULT_VALUE_SIZE    << " ]" << std::endl
+    << "    -i <iterations>                                  [ default: " << DEFAULT_ITERATIONS    << " ]" << std::endl
+    << "    -s <random_seed>                                 [ default: 0 ]"                               << std::endl;
+}
+
+bool parse_type(const char *arg, bool &is_string)
+{
+  if (strcmp(arg, "uint64") == 0)
+    is_string = false;
+  else if (strcmp(arg, "string") == 0)
+    is_string = true;
+  else
+    return false;
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  benchmark_options opts;
+  opts.messages = DEFAULT_NODE_MESSAGES;
+  opts.fanout = DEFAULT_FANOUT;
+  opts.key_size = DEFAULT_KEY_SIZE;
+  opts.value_size = DEFAULT_VALUE_SIZE;
+  opts.iterations = DEFAULT_ITERATIONS;
+  opts.random_seed = 0;
+  bool string_keys = false;
+  bool string_values = true;
+
+  int opt;
+  char *term;
+  uint64_t *target;
+  while ((opt = getopt(argc, argv, "n:F:K:k:V:v:i:s:")) != -1) {
+    switch (opt) {
+    case 'K':
+    case 'V':
+      if (!parse_type(optarg, opt == 'K' ? string_keys : string_values)) {
+	std::cerr << "Argument to -" << (char)opt << " must be \"uint64\" or \"string\"" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      continue;
+    case 'n': target = &opts.messages; break;
+    case 'F': target = &opts.fanout; break;
+    case 'k': target = &opts.key_size; break;
+    case 'v': target = &opts.value_size; break;
+    case 'i': target = &opts.iterations; break;
+    case 's': target = &opts.random_seed; break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+    *target = strtoull(optarg, &term, 10);
+    if (*term || (opt != 's' && *target == 0)) {
+      std::cerr << "Argument to -" << (char)opt << " must be a positive integer" << std::endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  // The map benchmark draws keys until it has -n distinct ones, and
+  // there are only 26^k string keys of k bytes.
+  if (string_keys) {
+    uint64_t distinct_keys = 1;
+    for (uint64_t i = 0; i < opts.key_size && distinct_keys < opts.messages; i++)
+      distinct_keys *= 26;
+    if (distinct_keys < opts.messages) {
+      std::cerr << "-n " << opts.messages << " is more than the " << distinct_keys
+		<< " distinct string keys of " << opts.key_size << " bytes" << std::endl;
+      exit(1);
+    }
+  }
+
+  printf("# keys %s%s, values %s%s, %ld messages, fanout %ld, %ld iterations\n",
+	 string_keys ? "string" : "uint64",
+	 string_keys ? (" of " + std::to_string(opts.key_size) + " bytes").c_str() : "",
+	 string_values ? "string" : "uint64",
+	 string_values ? (" of " + std::to_string(opts.value_size) + " bytes").c_str() : "",
+	 opts.messages, opts.fanout, opts.iterations);
+
+  if (string_keys && string_values)
+    serialization_benchmark<std::string, std::string>(opts).run();
+  else if (string_keys)
+    serialization_benchmark<std::string, uint64_t>(opts).run();
+  else if (string_values)
+    serialization_benchmark<uint64_t, std::string>(opts).run();
+  else
+    serialization_benchmark<uint64_t, uint64_t>(opts).run();
+
+  return 0;
+}
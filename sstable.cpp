@@ -0,0 +1,313 @@
+#include "sstable.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cassert>
+
+std::string sstable_key(uint64_t key)
+{
+  char buf[8];
+  for (int i = 0; i < 8; i++)
+    buf[i] = key >> (56 - 8 * i);
+  return std::string(buf, 8);
+}
+
+static uint64_t get_u64(const char *p)
+{
+  uint64_t x = 0;
+  for (int i = 7; i >= 0; i--)
+    x = x << 8 | (unsigned char)p[i];
+  return x;
+}
+
+static bool get_varint(const char *&p, const char *end, uint64_t &x)
+{
+  x = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    unsigned char c = *p++;
+    x |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+// memcmp order, with a proper prefix sorting first.
+static int compare_keys(const char *a, size_t alen, const char *b, size_t blen)
+{
+  int c = memcmp(a, b, alen < blen ? alen : blen);
+  if (c != 0)
+    return c;
+  return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+//////////////////////////////////////////
+// Implementation of the sstable_writer //
+//////////////////////////////////////////
+sstable_writer::sstable_writer(void)
+  : fd(-1),
+    offset(0),
+    records(0),
+    block_start(0),
+    current(0),
+    pending(-1),
+    failed(false),
+    stopping(false)
+{}
+
+sstable_writer::~sstable_writer(void)
+{
+  close();
+}
+
+bool sstable_writer::open(const char *filename)
+{
+  close();
+  fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  offset = 0;
+  records = 0;
+  block_start = 0;
+  block_first_key.clear();
+  last_key.clear();
+  index.clear();
+  first_keys.clear();
+  for (int i = 0; i < 2; i++) {
+    buffers[i].clear();
+    buffers[i].reserve(SSTABLE_WRITE_BUFFER_SIZE + SSTABLE_BLOCK_SIZE);
+  }
+  current = 0;
+  pending = -1;
+  failed = false;
+  stopping = false;
+  writer = std::thread(&sstable_writer::writer_main, this);
+  return true;
+}
+
+void sstable_writer::put_varint(uint64_t x)
+{
+  while (x >= 0x80) {
+    buffers[current].push_back((x & 0x7f) | 0x80);
+    x >>= 7;
+    offset++;
+  }
+  buffers[current].push_back(x);
+  offset++;
+}
+
+void sstable_writer::put_u64(uint64_t x)
+{
+  for (int i = 0; i < 8; i++)
+    buffers[current].push_back(x >> (8 * i));
+  offset += 8;
+}
+
+void sstable_writer::put_bytes(const char *p, size_t n)
+{
+  buffers[current].append(p, n);
+  offset += n;
+}
+
+void sstable_writer::end_block(void)
+{
+  if (offset == block_start)
+    return;
+  index.push_back(block_start);
+  index.push_back(offset - block_start);
+  first_keys.push_back(block_first_key);
+  block_start = offset;
+}
+
+// Hand the current buffer to the writer thread and start filling the
+// other one, once the writer has finished with it.
+void sstable_writer::submit(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (pending != -1)
+    wakeup.wait(guard);
+  pending = current;
+  current = 1 - current;
+  wakeup.notify_all();
+}
+
+void sstable_writer::writer_main(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    while (pending == -1 && !stopping)
+      wakeup.wait(guard);
+    if (pending == -1)
+      return;
+    std::string &buf = buffers[pending];
+    guard.unlock();
+    for (size_t done = 0; done < buf.size() && !failed; ) {
+      ssize_t r = ::write(fd, buf.data() + done, buf.size() - done);
+      if (r <= 0)
+	failed = true;
+      else
+	done += r;
+    }
+    buf.clear();
+    guard.lock();
+    pending = -1;
+    wakeup.notify_all();
+  }
+}
+
+void sstable_writer::add(const std::string &key, const std::string &value)
+{
+  assert(fd >= 0);
+  assert(records == 0 || compare_keys(last_key.data(), last_key.size(),
+				      key.data(), key.size()) < 0);
+  if (offset - block_start >= SSTABLE_BLOCK_SIZE)
+    end_block();
+  if (offset == block_start)
+    block_first_key = key;
+  put_varint(key.size());
+  put_varint(value.size());
+  put_bytes(key.data(), key.size());
+  put_bytes(value.data(), value.size());
+  last_key = key;
+  records++;
+  if (buffers[current].size() >= SSTABLE_WRITE_BUFFER_SIZE)
+    submit();
+}
+
+bool sstable_writer::close(void)
+{
+  if (fd < 0)
+    return true;
+  end_block();
+
+  uint64_t index_offset = offset;
+  uint64_t key_offset = 0;
+  for (size_t i = 0; i < first_keys.size(); i++) {
+    put_u64(index[2 * i]);
+    put_u64(index[2 * i + 1]);
+    put_u64(key_offset);
+    put_u64(first_keys[i].size());
+    key_offset += first_keys[i].size();
+  }
+  uint64_t keys_offset = offset;
+  for (size_t i = 0; i < first_keys.size(); i++)
+    put_bytes(first_keys[i].data(), first_keys[i].size());
+  put_bytes(SSTABLE_MAGIC, 8);
+  put_u64(index_offset);
+  put_u64(first_keys.size());
+  put_u64(keys_offset);
+  put_u64(records);
+  submit();
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  writer.join();
+
+  bool ok = !failed && fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  fd = -1;
+  return ok;
+}
+
+//////////////////////////////////////////
+// Implementation of the sstable_reader //
+//////////////////////////////////////////
+sstable_reader::sstable_reader(void)
+  : map(NULL),
+    map_size(0),
+    index(NULL),
+    blocks(0),
+    keys(NULL),
+    records(0)
+{}
+
+sstable_reader::~sstable_reader(void)
+{
+  close();
+}
+
+bool sstable_reader::open(const char *filename)
+{
+  close();
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < SSTABLE_FOOTER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  map = (const char *)p;
+  map_size = st.st_size;
+  madvise(p, map_size, MADV_RANDOM);
+
+  const char *footer = map + map_size - SSTABLE_FOOTER_SIZE;
+  uint64_t index_offset = get_u64(footer + 8);
+  blocks = get_u64(footer + 16);
+  uint64_t keys_offset = get_u64(footer + 24);
+  records = get_u64(footer + 32);
+  if (memcmp(footer, SSTABLE_MAGIC, 8) != 0 ||
+      index_offset + blocks * SSTABLE_INDEX_ENTRY_SIZE != keys_offset ||
+      keys_offset > map_size - SSTABLE_FOOTER_SIZE) {
+    close();
+    return false;
+  }
+  index = map + index_offset;
+  keys = map + keys_offset;
+  return true;
+}
+
+void sstable_reader::close(void)
+{
+  if (map)
+    munmap((void *)map, map_size);
+  map = NULL;
+  map_size = 0;
+  blocks = 0;
+  records = 0;
+}
+
+bool sstable_reader::get(const std::string &key, std::string &value) const
+{
+  // Find the last block whose first key is <= key.
+  uint64_t lo = 0, hi = blocks;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    const char *entry = index + mid * SSTABLE_INDEX_ENTRY_SIZE;
+    if (compare_keys(keys + get_u64(entry + 16), get_u64(entry + 24),
+		     key.data(), key.size()) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return false;
+
+  const char *entry = index + (lo - 1) * SSTABLE_INDEX_ENTRY_SIZE;
+  const char *p = map + get_u64(entry);
+  const char *end = p + get_u64(entry + 8);
+  while (p < end) {
+    uint64_t klen, vlen;
+    if (!get_varint(p, end, klen) || !get_varint(p, end, vlen) ||
+	(uint64_t)(end - p) < klen + vlen)
+      return false;
+    int c = compare_keys(p, klen, key.data(), key.size());
+    if (c == 0) {
+      value.assign(p + klen, vlen);
+      return true;
+    }
+    if (c > 0)
+      return false;
+    p += klen + vlen;
+  }
+  return false;
+}
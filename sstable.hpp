@@ -0,0 +1,124 @@
+// Sorted, immutable, block-indexed files of key/value pairs, for
+// shipping the contents of a betree to other systems.
+
+// The format is simple enough to read without this code:
+//
+//   data     records, each
+//              varint  key length
+//              varint  value length
+//              bytes   key
+//              bytes   value
+//            in strictly increasing order of key (compared as
+//            unsigned bytes, like memcmp), grouped into blocks of
+//            about SSTABLE_BLOCK_SIZE bytes.  A record never spans
+//            two blocks.
+//   index    one 32-byte entry per block:
+//              u64  offset of the block in the file
+//              u64  length of the block
+//              u64  offset of the block's first key in the key area
+//              u64  length of the block's first key
+//   keys     the first key of every block, back to back
+//   footer   40 bytes:
+//              8 bytes  SSTABLE_MAGIC
+//              u64      offset of the index
+//              u64      number of blocks
+//              u64      offset of the key area
+//              u64      number of records
+//
+// Integers are little-endian, and varints are LEB128, as in
+// workload_trace.hpp.  To look a key up, binary-search the index for
+// the last block whose first key is not greater than it, then scan
+// that block.
+
+// The writer fills one of two SSTABLE_WRITE_BUFFER_SIZE buffers
+// while a background thread write()s the other, so the file is
+// produced with large sequential writes and the producer rarely
+// waits for the disk.
+
+#ifndef SSTABLE_HPP
+#define SSTABLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define SSTABLE_MAGIC "BeTrSST1"
+#define SSTABLE_BLOCK_SIZE (4096)
+#define SSTABLE_WRITE_BUFFER_SIZE (1ULL << 20)
+#define SSTABLE_FOOTER_SIZE (40)
+#define SSTABLE_INDEX_ENTRY_SIZE (32)
+
+// Keys compare as unsigned bytes, so integer keys must be stored
+// big-endian to keep their numeric order.
+std::string sstable_key(uint64_t key);
+
+class sstable_writer {
+public:
+  sstable_writer(void);
+  ~sstable_writer(void);
+
+  bool open(const char *filename);
+  // Keys must be added in strictly increasing order.
+  void add(const std::string &key, const std::string &value);
+  // Write the index and footer, sync and close the file.  Returns
+  // false if any write failed.
+  bool close(void);
+
+  uint64_t get_records(void) const { return records; }
+  uint64_t get_bytes(void) const { return offset; }
+
+private:
+  void put_varint(uint64_t x);
+  void put_u64(uint64_t x);
+  void put_bytes(const char *p, size_t n);
+  void end_block(void);
+  void submit(void);
+  void writer_main(void);
+
+  int fd;
+  uint64_t offset;		// of the next byte to be added
+  uint64_t records;
+  uint64_t block_start;
+  std::string block_first_key;
+  std::string last_key;
+  std::vector<uint64_t> index;	// offset and length of each block
+  std::vector<std::string> first_keys;
+
+  // buffers[current] is being filled.  The writer thread writes
+  // buffers[pending], if pending is not -1.
+  std::string buffers[2];
+  int current;
+  int pending;
+  bool failed;
+  bool stopping;
+  std::mutex lock;
+  std::condition_variable wakeup;
+  std::thread writer;
+};
+
+// Looks keys up in an sstable through a read-only mapping of it.
+class sstable_reader {
+public:
+  sstable_reader(void);
+  ~sstable_reader(void);
+
+  bool open(const char *filename);
+  void close(void);
+
+  bool get(const std::string &key, std::string &value) const;
+  uint64_t size(void) const { return records; }
+
+private:
+  const char *map;
+  size_t map_size;
+  const char *index;
+  uint64_t blocks;
+  const char *keys;
+  uint64_t records;
+};
+
+#endif // SSTABLE_HPP
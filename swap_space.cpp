@@ -43,7 +43,7 @@ void deserialize(std::iostream &fs, serialization_context &context, std::string
   fs.read(buf, length);
   assert(fs.good());
   x = std::string(buf, length);
-  delete buf;
+  delete[] buf;
 }
 
 bool swap_space::cmp_by_last_access(swap_space::object *a, swap_space::object *b) {
@@ -68,6 +68,55 @@ swap_space::object::object(swap_space *sspace, serializable * tgt) {
   pincount = 0;
 }
 
+swap_space::statistics::statistics(void)
+  : hits(0),
+    misses(0),
+    loads(0),
+    evictions(0),
+    write_backs(0),
+    bytes_serialized(0),
+    bytes_deserialized(0),
+    objects(0),
+    in_memory_objects(0),
+    max_in_memory_objects(0)
+{}
+
+swap_space::statistics swap_space::stats(void) const {
+  statistics result = counters;
+  result.objects = objects.size();
+  result.in_memory_objects = current_in_memory_objects;
+  result.max_in_memory_objects = max_in_memory_objects;
+  return result;
+}
+
+static void print_metric(std::ostream &out, const char *name,
+			 const char *type, uint64_t value)
+{
+  out << "# TYPE " << name << " " << type << std::endl
+      << name << " " << value << std::endl;
+}
+
+void swap_space::statistics::print_prometheus(std::ostream &out) const {
+  print_metric(out, "swap_space_cache_hits_total", "counter", hits);
+  print_metric(out, "swap_space_cache_misses_total", "counter", misses);
+  print_metric(out, "swap_space_loads_total", "counter", loads);
+  print_metric(out, "swap_space_evictions_total", "counter", evictions);
+  print_metric(out, "swap_space_write_backs_total", "counter", write_backs);
+  print_metric(out, "swap_space_serialized_bytes_total", "counter", bytes_serialized);
+  print_metric(out, "swap_space_deserialized_bytes_total", "counter", bytes_deserialized);
+  print_metric(out, "swap_space_objects", "gauge", objects);
+  print_metric(out, "swap_space_in_memory_objects", "gauge", in_memory_objects);
+  print_metric(out, "swap_space_max_in_memory_objects", "gauge", max_in_memory_objects);
+}
+
+void swap_space::sync(void) {
+  backstore->sync();
+}
+
+void swap_space::set_overwrite_in_place(bool overwrite) {
+  overwrite_in_place = overwrite;
+}
+
 void swap_space::set_cache_size(uint64_t sz) {
   assert(sz > 0);
   max_in_memory_objects = sz;
@@ -78,9 +127,7 @@ void swap_space::write_back(swap_space::object *obj)
 {
   assert(objects.count(obj->id) > 0);
 
-  debug(std::cout << "Writing back " << obj->id
-	<< " (" << obj->target << ") "
-	<< "with last access time " << obj->last_access << std::endl);
+  TRACE_SPAN(span, "write_back", obj->id);
 
   // This calls _serialize on all the pointers in this object,
   // which keeps refcounts right later on when we delete them all.
@@ -88,20 +135,27 @@ void swap_space::write_back(swap_space::object *obj)
   // evictions, i.e. where we first "evict" an object by
   // compressing it and keeping the compressed version in memory.
   serialization_context ctxt(*this);
-  std::stringstream sstream;
-  serialize(sstream, ctxt, *obj->target);
+  write_buffer.start_write();
+  serialize(write_buffer, ctxt, *obj->target);
   obj->is_leaf = ctxt.is_leaf;
+  size_t length = write_buffer.written();
+  counters.bytes_serialized += length;
 
   if (obj->target_is_dirty) {
-    std::string buffer = sstream.str();
-    uint64_t bsid = backstore->allocate(buffer.length());
-    std::iostream *out = backstore->get(bsid);
-    out->write(buffer.data(), buffer.length());
-    backstore->put(out);
-    if (obj->bsid > 0)
+    uint64_t bsid;
+    if (overwrite_in_place && obj->bsid > 0 &&
+	backstore->overwrite(obj->bsid, length))
+      bsid = obj->bsid;
+    else
+      bsid = backstore->allocate(length);
+    backstore->set_is_leaf(bsid, obj->is_leaf);
+    backstore->write(bsid, write_buffer.data(), length);
+    if (obj->bsid > 0 && obj->bsid != bsid)
       backstore->deallocate(obj->bsid);
     obj->bsid = bsid;
     obj->target_is_dirty = false;
+    counters.write_backs++;
+    TRACE_ARG(span, 0, "bytes", length);
   }
 }
 
@@ -116,6 +170,9 @@ void swap_space::maybe_evict_something(void)
       }
     if (obj == NULL)
       return;
+    TRACE_SPAN(span, "evict", obj->id);
+    TRACE_ARG(span, 0, "dirty", obj->target_is_dirty);
+    TRACE_ARG(span, 1, "in_memory", current_in_memory_objects);
     lru_pqueue.erase(obj);
 
     write_back(obj);
@@ -123,6 +180,7 @@ void swap_space::maybe_evict_something(void)
     delete obj->target;
     obj->target = NULL;
     current_in_memory_objects--;
+    counters.evictions++;
   }
 }
 
@@ -78,7 +78,7 @@
 #include <sstream>
 #include <cassert>
 #include "backing_store.hpp"
-#include "debug.hpp"
+#include "trace.hpp"
 
 class swap_space;
 
@@ -179,6 +179,40 @@ public:
     return pointer<Referent>(this, tgt);
   }
 
+  // Cache and I/O counters.  All counters are cumulative since the
+  // swap_space was created.  stats() just copies them, so it is cheap
+  // enough to poll frequently.
+  class statistics {
+  public:
+    statistics(void);
+    void print_prometheus(std::ostream &out) const;
+
+    uint64_t hits;		// accesses to an object already in memory
+    uint64_t misses;		// accesses that had to load the object
+    uint64_t loads;		// includes loads done to garbage collect
+    uint64_t evictions;
+    uint64_t write_backs;	// evictions of dirty objects
+    uint64_t bytes_serialized;
+    uint64_t bytes_deserialized;
+    uint64_t objects;		// currently managed objects
+    uint64_t in_memory_objects;
+    uint64_t max_in_memory_objects;
+  };
+
+  statistics stats(void) const;
+
+  // A durability barrier: make every object written back so far
+  // durable, as far as the backing store's durability setting
+  // allows.  Objects that are dirty in memory are not written.
+  void sync(void);
+
+  // Whether dirty objects may be written back over their previous
+  // image, when the backing store supports it, instead of to a newly
+  // allocated object.  Overwriting saves an allocation and a
+  // deallocation per write-back, but a crash in the middle of a
+  // write-back then loses the object, so it is off by default.
+  void set_overwrite_in_place(bool overwrite);
+
   // This pins an object in memory for the duration of a member
   // access.  It's sort of an instance of the "resource aquisition is
   // initialization" paradigm.
@@ -187,16 +221,12 @@ public:
   public:
     const Referent * operator->(void) const {
       assert(ss->objects.count(target) > 0);
-      debug(std::cout << "Accessing (constly) " << target
-	    << " (" << ss->objects[target]->target << ")" << std::endl);
       access(target, false);
       return (const Referent *)ss->objects[target]->target;
     }
 
     Referent * operator->(void) {
       assert(ss->objects.count(target) > 0);
-      debug(std::cout << "Accessing " << target
-	    << " (" << ss->objects[target]->target << ")" << std::endl);
       access(target, true);
       return (Referent *)ss->objects[target]->target;
     }
@@ -226,8 +256,6 @@ public:
     
   private:
     void unpin(void) {
-      debug(std::cout << "Unpinning " << target
-	    << " (" << ss->objects[target]->target << ")" << std::endl);
       if (target > 0) {
 	assert(ss->objects.count(target) > 0);
 	ss->objects[target]->pincount--;
@@ -243,8 +271,6 @@ public:
       target = newtarget;
       if (target > 0) {
 	assert(ss->objects.count(target) > 0);
-	debug(std::cout << "Pinning " << target
-	      << " (" << ss->objects[target]->target << ")" << std::endl);
 	ss->objects[target]->pincount++;
       }
     }
@@ -252,6 +278,10 @@ public:
     void access(uint64_t tgt, bool dirty) const {
       assert(ss->objects.count(tgt) > 0);
       object *obj = ss->objects[tgt];
+      if (obj->target)
+	ss->counters.hits++;
+      else
+	ss->counters.misses++;
       ss->lru_pqueue.erase(obj);
       obj->last_access = ss->next_access_time++;
       ss->lru_pqueue.insert(obj);
@@ -296,15 +326,13 @@ public:
       object *obj = ss->objects[target];
       assert(obj->refcount > 0);
       if ((--obj->refcount) == 0) {
-	debug(std::cout << "Erasing " << target << std::endl);
+	TRACE_INSTANT("erase", target, "on_disk", obj->target == NULL);
 	// Load it into memory so we can recursively free stuff
 	if (obj->target == NULL) {
 	  assert(obj->bsid > 0);
-	  if (!obj->is_leaf) {
+	  // Leaves don't point to anything, so we needn't load them.
+	  if (!obj->is_leaf)
 	    ss->load<Referent>(target);
-	  } else {
-	    debug(std::cout << "Skipping load of leaf " << target << std::endl);
-	  }
 	}
 	ss->objects.erase(target);
 	ss->lru_pqueue.erase(obj);
@@ -360,11 +388,26 @@ public:
       return pin<Referent>(this);
     }
     
+    // The swap_space object id, which is also the id of the
+    // object's load, write-back and evict trace events.
+    uint64_t get_id(void) const {
+      return target;
+    }
+
     bool is_in_memory(void) const {
       assert(ss->objects.count(target) > 0);
       return target > 0 && ss->objects[target]->target != NULL;
     }
 
+    // The object if it is in memory, otherwise NULL.  Unlike
+    // operator->, this is not an access: it never loads or evicts
+    // anything and leaves the LRU order and hit/miss counters alone,
+    // so it is for observers such as betree::stats().
+    const Referent * peek(void) const {
+      assert(ss->objects.count(target) > 0);
+      return target > 0 ? (const Referent *)ss->objects[target]->target : NULL;
+    }
+
     bool is_dirty(void) const {
       assert(ss->objects.count(target) > 0);
       return target > 0 && ss->objects[target]->target && ss->objects[target]->target_is_dirty;
@@ -440,14 +483,18 @@ private:
     assert(objects.count(tgt) > 0);
     if (objects[tgt]->target == NULL) {
       object *obj = objects[tgt];
-      debug(std::cout << "Loading " << obj->id << std::endl);
-      std::iostream *in = backstore->get(obj->bsid);
+      TRACE_SPAN(span, "load", obj->id);
+      backstore->read(obj->bsid, read_buffer);
       Referent *r = new Referent();
       serialization_context ctxt(*this);
-      deserialize(*in, ctxt, *r);
-      backstore->put(in);
+      deserialize(read_buffer, ctxt, *r);
+      uint64_t bytes = read_buffer.tellg();
+      TRACE_ARG(span, 0, "bsid", obj->bsid);
+      TRACE_ARG(span, 1, "bytes", bytes);
       obj->target = r;
       current_in_memory_objects++;
+      counters.loads++;
+      counters.bytes_deserialized += bytes;
     }
   }
 
@@ -458,6 +505,13 @@ private:
   
   uint64_t max_in_memory_objects;
   uint64_t current_in_memory_objects = 0;
+  bool overwrite_in_place = false;
+  // Reused for every load and write-back, so that node images are
+  // serialized into and parsed out of the backing store's I/O
+  // buffers without intermediate copies.
+  buffer_stream read_buffer;
+  buffer_stream write_buffer;
+  statistics counters;
   std::unordered_map<uint64_t, object *> objects;
   std::set<object *, bool (*)(object *, object *)> lru_pqueue;
 };
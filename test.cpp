@@ -11,22 +11,129 @@
 
 #include <string.h>
 #include <sys/types.h>
-#include <sys/time.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "betree.hpp"
+#include "histogram.hpp"
+#include "key_distribution.hpp"
+#include "workload_trace.hpp"
+#include "perf_counters.hpp"
+#include "allocation_counter.hpp"
+#include "log_backing_store.hpp"
+#include "mmap_backing_store.hpp"
+#include "direct_backing_store.hpp"
+#include "tiered_backing_store.hpp"
+#include "sstable.hpp"
+#include "frozen_betree.hpp"
 
+// Timers are in microseconds.
 void timer_start(uint64_t &timer)
 {
-  struct timeval t;
-  assert(!gettimeofday(&t, NULL));
-  timer -= 1000000*t.tv_sec + t.tv_usec;
+  timer -= now_ns() / 1000;
 }
 
 void timer_stop(uint64_t &timer)
 {
-  struct timeval t;
-  assert(!gettimeofday(&t, NULL));
-  timer += 1000000*t.tv_sec + t.tv_usec;
+  timer += now_ns() / 1000;
+}
+
+// If -R is given, the operations of the run are captured here.  The
+// tree records its own upserts, queries and scan()s (see
+// betree::set_recorder()); the harness adds batch boundaries and the
+// scans the test mode makes with iterators.
+workload_trace_writer *capture = NULL;
+
+void capture_op(int op, uint64_t key, uint64_t arg)
+{
+  if (capture)
+    capture->record(op, key, arg);
+}
+
+void capture_begin_batch(void)
+{
+  if (capture)
+    capture->begin_batch();
+}
+
+void capture_end_batch(void)
+{
+  if (capture)
+    capture->end_batch();
+}
+
+// If -H is given, benchmarks report these counters for each phase.
+perf_counters *perf = NULL;
+
+perf_counters::values perf_snapshot(void)
+{
+  return perf ? perf->read() : perf_counters::values();
+}
+
+void print_perf(const char *phase, const perf_counters::values &v)
+{
+  if (perf)
+    perf->print(phase, v);
+}
+
+// If -A is given, benchmarks report heap allocations for each phase,
+// and the heap in use relative to heap_baseline, the live bytes just
+// before the tree was created.  The objects of an in-memory backing
+// store are on the heap, too, so their size is subtracted to estimate
+// the heap used by cached nodes.
+bool report_allocations = false;
+uint64_t heap_baseline = 0;
+bool store_on_heap = false;
+
+// The heap in use and the number of cached nodes at the end of a
+// phase.  Phases whose report is printed after a later phase has run
+// take this when they end, so that their figures are their own.
+struct heap_usage {
+  uint64_t live_bytes;
+  uint64_t cached_nodes;
+};
+
+heap_usage get_heap_usage(betree<uint64_t, std::string> &b,
+			  accounting_backing_store &io)
+{
+  heap_usage heap = { 0, 0 };
+  if (!report_allocations)
+    return heap;
+  heap.live_bytes = get_allocation_counters().live_bytes() - heap_baseline;
+  if (store_on_heap)
+    heap.live_bytes -= std::min(heap.live_bytes, io.get_live_bytes());
+  betree<uint64_t, std::string>::statistics st = b.stats();
+  for (auto it = st.levels.begin(); it != st.levels.end(); ++it)
+    heap.cached_nodes += it->resident_nodes;
+  return heap;
+}
+
+void print_allocations(const char *phase,
+		       const allocation_counters &a,
+		       uint64_t nops,
+		       const heap_usage &heap)
+{
+  if (!report_allocations)
+    return;
+  printf("# %s alloc: %ld allocations %ld frees %ld bytes, %.2f allocations/op %.1f bytes/op\n",
+	 phase, a.allocations, a.frees, a.bytes_allocated,
+	 nops ? (double)a.allocations / nops : 0.0,
+	 nops ? (double)a.bytes_allocated / nops : 0.0);
+  printf("# %s heap: %ld live bytes, %ld cached nodes, %.0f bytes/node\n",
+	 phase, heap.live_bytes, heap.cached_nodes,
+	 heap.cached_nodes ? (double)heap.live_bytes / heap.cached_nodes : 0.0);
+}
+
+void print_allocations(const char *phase,
+		       const allocation_counters &a,
+		       uint64_t nops,
+		       betree<uint64_t, std::string> &b,
+		       accounting_backing_store &io)
+{
+  print_allocations(phase, a, nops, get_heap_usage(b, io));
 }
 
 int next_command(FILE *input, int *op, uint64_t *arg)
@@ -79,9 +186,6 @@ void do_scan(typename betree<Key, Value>::iterator &betit,
     assert(betit.first == refit->first);
     assert(betit.second == refit->second);
     ++refit;
-    if (refit == reference.end()) {
-      debug(std::cout << "Almost done" << std::endl);
-    }
     ++betit;
   }
   assert(betit == b.end());
@@ -92,6 +196,18 @@ void do_scan(typename betree<Key, Value>::iterator &betit,
 #define DEFAULT_TEST_CACHE_SIZE (4)
 #define DEFAULT_TEST_NDISTINCT_KEYS (1ULL << 10)
 #define DEFAULT_TEST_NOPS (1ULL << 12)
+#define DEFAULT_TEST_VALUE_SIZE (100)
+#define DEFAULT_TEST_MAX_SCAN_LENGTH (100)
+#define DEFAULT_TEST_FAST_TIER_CAPACITY (64)
+
+// stream_seed() index of the YCSB operation-type generator.  Key
+// distributions are seeded with the -s seed itself.
+#define OPERATION_STREAM (1)
+// In threads mode, client i draws keys from stream
+// CLIENT_KEY_STREAM(i) and operation types from stream
+// CLIENT_OPERATION_STREAM(i).
+#define CLIENT_KEY_STREAM(i) (2 + 2 * (i))
+#define CLIENT_OPERATION_STREAM(i) (3 + 2 * (i))
 
 void usage(char *name)
 {
@@ -101,19 +217,64 @@ void usage(char *name)
     << std::endl
     << "Options are" << std::endl
     << "  Required:"   << std::endl
-    << "    -d <backing_store_directory>                    [ default: none, parameter is required ]"           << std::endl
+    << "    -d <backing_store_directory>                    [ default: none, required for file backing store ]" << std::endl
     << "    -m  <mode>  (test or benchmark-<mode>)          [ default: none, parameter required ]"              << std::endl
     << "        benchmark modes:"                                                                               << std::endl
     << "          upserts    "                                                                                  << std::endl
     << "          queries    "                                                                                  << std::endl
+    << "          scans      (-t scans of -l keys over -k preloaded keys)"                                      << std::endl
+    << "          ycsb-a ... ycsb-f  (YCSB core workloads A-F, using -k records)"                                 << std::endl
+    << "          sweep      (YCSB workloads -w over every -N, -f and -C in the given lists)"                    << std::endl
+    << "          replay     (replay the workload trace given with -r)"                                         << std::endl
+    << "          threads    (YCSB workloads -w with every -j client threads, shared and sharded)"              << std::endl
     << "  Betree tuning parameters:" << std::endl
     << "    -N <max_node_size>            (in elements)     [ default: " << DEFAULT_TEST_MAX_NODE_SIZE  << " ]" << std::endl
     << "    -f <min_flush_size>           (in elements)     [ default: " << DEFAULT_TEST_MIN_FLUSH_SIZE << " ]" << std::endl
     << "    -C <max_cache_size>           (in betree nodes) [ default: " << DEFAULT_TEST_CACHE_SIZE     << " ]" << std::endl
+    << "  Backing store options:" << std::endl
+    << "    -b <backing_store>            (file, memory, log, mmap, direct or tiered) [ default: file ]"        << std::endl
+    << "        tiered keeps hot objects in files in -d and cold ones in files in -S"                           << std::endl
+    << "    -S <slow_tier_directory>      (tiered)          [ default: none ]"                                  << std::endl
+    << "    -M <fast_tier_capacity>       (in MB, tiered)   [ default: " << DEFAULT_TEST_FAST_TIER_CAPACITY << " ]" << std::endl
+    << "    -L <io_latency>               (in us, memory)   [ default: 0 ]"                                     << std::endl
+    << "    -B <io_bandwidth>             (in MB/s, memory) [ default: unlimited ]"                             << std::endl
+    << "    -I                            (overwrite node images in place) [ default: off ]"                   << std::endl
+    << "    -Y <durability>               (none, ordered or full, all but memory) [ default: full ]"           << std::endl
+    << "        ordered syncs at benchmark batch boundaries: upsert rounds, the end of"                        << std::endl
+    << "        each load or run phase, and the end of each replayed batch"                                    << std::endl
     << "  Options for both tests and benchmarks" << std::endl
     << "    -k <number_of_distinct_keys>                    [ default: " << DEFAULT_TEST_NDISTINCT_KEYS << " ]" << std::endl
     << "    -t <number_of_operations>                       [ default: " << DEFAULT_TEST_NOPS           << " ]" << std::endl
     << "    -s <random_seed>                                [ default: random ]"                                << std::endl
+    << "  Benchmark key distribution options" << std::endl
+    << "    -D <distribution>                               [ default: uniform (ycsb: per workload) ]"         << std::endl
+    << "        uniform, zipfian, sequential, reverse-sequential, latest, hotspot"                             << std::endl
+    << "    -z <zipfian_theta>            (0 < theta < 1)   [ default: " << DEFAULT_ZIPFIAN_THETA      << " ]" << std::endl
+    << "  Scan and YCSB options" << std::endl
+    << "    -v <value_size>               (in bytes)        [ default: " << DEFAULT_TEST_VALUE_SIZE      << " ]" << std::endl
+    << "    -l <(max_)scan_length>        (in keys)         [ default: " << DEFAULT_TEST_MAX_SCAN_LENGTH << " ]" << std::endl
+    << "  Sweep options" << std::endl
+    << "    -N, -f, -C accept comma-separated lists, e.g. -N 64,256,1024 [ default -f: N/4 ]"                   << std::endl
+    << "    -w <workloads>                (e.g. a,b,f, also for threads) [ default: a ]"                        << std::endl
+    << "    -F <format>                   (csv or json)     [ default: csv ]"                                   << std::endl
+    << "  Statistics options" << std::endl
+    << "    -P <stats_file>               (Prometheus text) [ default: none ]"                                  << std::endl
+    << "  Export options" << std::endl
+    << "    -X <sstable_file>             (export the tree after the run) [ default: none ]"                  << std::endl
+    << "    -Z <frozen_file>              (freeze the tree after the run) [ default: none ]"                  << std::endl
+    << "  Threads options" << std::endl
+    << "    -j <thread_counts>            (comma-separated) [ default: 1,2,4 ]"                                 << std::endl
+    << "  Performance counter options" << std::endl
+    << "    -H                            (report perf_event counters per phase) [ default: off ]"             << std::endl
+    << "  Allocation accounting options" << std::endl
+    << "    -A                            (report heap allocations per phase) [ default: off ]"                 << std::endl
+    << "        requires a build with -DCOUNT_ALLOCATIONS"                                                     << std::endl
+    << "  Workload capture and replay options" << std::endl
+    << "    -R <workload_trace>           (capture the operations of this run) [ default: none ]"              << std::endl
+    << "    -r <workload_trace>           (trace to replay) [ default: none ]"                                  << std::endl
+    << "    -p                            (replay at the original pace) [ default: full speed ]"                << std::endl
+    << "  Tracing options (requires building with -DTRACE)" << std::endl
+    << "    -T <trace_file>               (Chrome trace JSON) [ default: no trace ]"                            << std::endl
     << "  Test scripting options" << std::endl
     << "    -o <output_script>                              [ default: no output ]"                             << std::endl
     << "    -i <script_file>                                [ default: none ]"                                  << std::endl;
@@ -183,6 +344,7 @@ int test(betree<uint64_t, std::string> &b,
 	  fprintf(script_output, "Full_scan 0\n");
 	auto betit = b.begin();
 	auto refit = reference.begin();
+	capture_op(WORKLOAD_SCAN, 0, reference.size());
 	do_scan(betit, refit, b, reference);
       }
       break;
@@ -192,6 +354,7 @@ int test(betree<uint64_t, std::string> &b,
 	  fprintf(script_output, "Lower_bound_scan %lu\n", t);
 	auto betit = b.lower_bound(t);
 	auto refit = reference.lower_bound(t);
+	capture_op(WORKLOAD_SCAN, t, std::distance(refit, reference.end()));
 	do_scan(betit, refit, b, reference);
       }
       break;
@@ -201,6 +364,7 @@ int test(betree<uint64_t, std::string> &b,
 	  fprintf(script_output, "Upper_bound_scan %lu\n", t);
 	auto betit = b.upper_bound(t);
 	auto refit = reference.upper_bound(t);
+	capture_op(WORKLOAD_SCAN, t + 1, std::distance(refit, reference.end()));
 	do_scan(betit, refit, b, reference);
       }
       break;
@@ -209,68 +373,1123 @@ int test(betree<uint64_t, std::string> &b,
     }
   }
 
+  // The bulk traversal used for exports must agree with the reference.
+  auto refit = reference.begin();
+  b.for_each([&](const uint64_t &k, const std::string &v) {
+      assert(refit != reference.end());
+      assert(k == refit->first && v == refit->second);
+      ++refit;
+    });
+  assert(refit == reference.end());
+
   std::cout << "Test PASSED" << std::endl;
   
   return 0;
 }
 
+// Write the tree and swap_space statistics to filename in the
+// Prometheus text format.  The file is replaced atomically, so that a
+// collector polling it never sees a partial file.
+bool export_stats(const char *filename,
+		  const betree<uint64_t, std::string> &b,
+		  const swap_space &sspace)
+{
+  std::string tmpname = std::string(filename) + ".tmp";
+  {
+    std::ofstream out(tmpname);
+    b.stats().print_prometheus(out);
+    sspace.stats().print_prometheus(out);
+    if (!out.good())
+      return false;
+  }
+  return rename(tmpname.c_str(), filename) == 0;
+}
+
+// Report the I/O performed during a benchmark phase of nops
+// operations that upserted user_bytes bytes of keys and values.
+void print_io(const char *phase,
+	      const accounting_backing_store::counters &io,
+	      uint64_t nops,
+	      uint64_t user_bytes)
+{
+  printf("# %s io: gets %ld puts %ld allocations %ld deallocations %ld overwrites %ld syncs %ld\n",
+	 phase, io.gets, io.puts, io.allocations, io.deallocations,
+	 io.overwrites, io.syncs);
+  printf("# %s io: read %ld objects %ld bytes, %.2f objects/op %.1f bytes/op\n",
+	 phase, io.reads, io.bytes_read,
+	 nops ? (double)io.reads / nops : 0.0,
+	 nops ? (double)io.bytes_read / nops : 0.0);
+  printf("# %s io: wrote %ld objects %ld bytes, write amplification %.2f\n",
+	 phase, io.writes, io.bytes_written,
+	 user_bytes ? (double)io.bytes_written / user_bytes : 0.0);
+}
+
+// Total size of the keys and values currently in the tree.  This
+// scans the whole tree, so call it after all measurements are done.
+uint64_t logical_bytes(betree<uint64_t, std::string> &b)
+{
+  uint64_t user_bytes = 0;
+  for (auto it = b.begin(); it != b.end(); ++it)
+    user_bytes += sizeof(it.first) + it.second.size();
+  return user_bytes;
+}
+
+// Report the space used on the backing store relative to the size of
+// the keys and values currently in the tree.
+void print_space(betree<uint64_t, std::string> &b,
+		 accounting_backing_store &io)
+{
+  uint64_t live_bytes = io.get_live_bytes();
+  uint64_t live_objects = io.get_live_objects();
+  uint64_t user_bytes = logical_bytes(b);
+  printf("# space: %ld objects %ld bytes for %ld bytes of data, space amplification %.2f\n",
+	 live_objects, live_bytes, user_bytes,
+	 user_bytes ? (double)live_bytes / user_bytes : 0.0);
+}
+
+// Report the log store's segment usage and cleaning work.
+void print_log(const log_backing_store &store)
+{
+  log_backing_store::statistics s = store.stats();
+  printf("# log: %ld segments %ld bytes (%ld live), %ld bytes appended, "
+	 "%ld sealed %ld freed %ld cleaned, %ld bytes relocated\n",
+	 s.segments, s.disk_bytes, s.live_bytes, s.bytes_appended,
+	 s.segments_sealed, s.segments_freed, s.segments_cleaned,
+	 s.bytes_relocated);
+}
+
+// Report how well a single-file store is reusing its space.
+void print_free_space(const free_space_manager::statistics &s)
+{
+  printf("# free space: file %ld bytes, %ld free in %ld extents (%.2f), %ld relocations\n",
+	 s.size, s.free_bytes, s.free_extents,
+	 s.size ? (double)s.free_bytes / s.size : 0.0, s.relocations);
+}
+
+// Report where the tiered store has put objects and how many it has
+// moved.
+void print_tiers(const tiered_backing_store &store)
+{
+  tiered_backing_store::statistics s = store.stats();
+  printf("# tiers: fast %ld objects %ld bytes, slow %ld objects %ld bytes, "
+	 "%ld promotions %ld demotions\n",
+	 s.objects[tiered_backing_store::FAST], s.bytes[tiered_backing_store::FAST],
+	 s.objects[tiered_backing_store::SLOW], s.bytes[tiered_backing_store::SLOW],
+	 s.promotions, s.demotions);
+}
+
+// Write every key/value pair in the tree to an sstable, and, if
+// verify is set, check that the file holds exactly the tree's
+// contents.
+bool export_sstable(betree<uint64_t, std::string> &b,
+		    const char *filename,
+		    bool verify)
+{
+  sstable_writer writer;
+  if (!writer.open(filename))
+    return false;
+  uint64_t start = now_ns();
+  b.for_each([&](const uint64_t &k, const std::string &v) {
+      writer.add(sstable_key(k), v);
+    });
+  uint64_t records = writer.get_records();
+  uint64_t bytes = writer.get_bytes();
+  if (!writer.close())
+    return false;
+  double seconds = (now_ns() - start) / 1e9;
+  printf("# export: %ld records %ld bytes in %.3f s, %.1f MB/s\n",
+	 records, bytes, seconds, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+
+  if (verify) {
+    sstable_reader reader;
+    assert(reader.open(filename));
+    assert(reader.size() == records);
+    std::string v;
+    b.for_each([&](const uint64_t &k, const std::string &value) {
+	assert(reader.get(sstable_key(k), v) && v == value);
+      });
+  }
+  return true;
+}
+
+// Freeze the tree into filename, check that the frozen image holds
+// exactly the tree's contents if verify is set, and compare the cost
+// of random queries against the frozen image and the live tree.
+bool freeze_tree(betree<uint64_t, std::string> &b,
+		 const char *filename,
+		 uint64_t number_of_distinct_keys,
+		 bool verify)
+{
+  frozen_betree_writer writer;
+  if (!writer.open(filename))
+    return false;
+  uint64_t start = now_ns();
+  b.for_each([&](const uint64_t &k, const std::string &v) {
+      writer.add(k, v);
+    });
+  uint64_t records = writer.get_records();
+  uint64_t bytes = writer.get_bytes();
+  if (!writer.close())
+    return false;
+  printf("# freeze: %ld records %ld bytes in %.3f s\n",
+	 records, bytes, (now_ns() - start) / 1e9);
+
+  frozen_betree frozen;
+  if (!frozen.open(filename))
+    return false;
+  assert(frozen.size() == records);
+  if (verify) {
+    std::string v;
+    b.for_each([&](const uint64_t &k, const std::string &value) {
+	assert(frozen.query(k, v) && v == value);
+      });
+    for (uint64_t t = 0; t < number_of_distinct_keys; t++) {
+      bool in_tree = true;
+      try {
+	b.query(t);
+      } catch (std::out_of_range &e) {
+	in_tree = false;
+      }
+      assert(frozen.query(t, v) == in_tree);
+    }
+    return true;
+  }
+
+  uint64_t nqueries = std::min<uint64_t>(number_of_distinct_keys, 100000);
+  std::vector<uint64_t> keys(nqueries);
+  for (uint64_t i = 0; i < nqueries; i++)
+    keys[i] = rand() % number_of_distinct_keys;
+
+  uint64_t found = 0;
+  start = now_ns();
+  for (uint64_t i = 0; i < nqueries; i++) {
+    const char *p;
+    size_t n;
+    found += frozen.get(keys[i], p, n);
+  }
+  double frozen_seconds = (now_ns() - start) / 1e9;
+
+  start = now_ns();
+  for (uint64_t i = 0; i < nqueries; i++) {
+    try {
+      b.query(keys[i]);
+    } catch (std::out_of_range &e) {
+    }
+  }
+  double tree_seconds = (now_ns() - start) / 1e9;
+  printf("# frozen: %ld queries, %ld found, %.0f ns/query (betree: %.0f ns/query)\n",
+	 nqueries, found, frozen_seconds * 1e9 / std::max<uint64_t>(nqueries, 1),
+	 tree_seconds * 1e9 / std::max<uint64_t>(nqueries, 1));
+  return true;
+}
+
 void benchmark_upserts(betree<uint64_t, std::string> &b,
 		       uint64_t nops,
 		       uint64_t number_of_distinct_keys,
-		       uint64_t random_seed)
+		       key_distribution &keys,
+		       accounting_backing_store &io)
 {
+  latency_histogram latencies;
+  accounting_backing_store::counters io_start = io.get_counters();
+  perf_counters::values perf_start = perf_snapshot();
+  allocation_counters alloc_start = get_allocation_counters();
+  uint64_t user_bytes = 0;
   uint64_t overall_timer = 0;
   for (uint64_t j = 0; j < 100; j++) {
     uint64_t timer = 0;
+    capture_begin_batch();
     timer_start(timer);
     for (uint64_t i = 0; i < nops / 100; i++) {
-      uint64_t t = rand() % number_of_distinct_keys;
-      b.update(t, std::to_string(t) + ":");
+      uint64_t t = keys.next(number_of_distinct_keys);
+      std::string value = std::to_string(t) + ":";
+      uint64_t start = now_ns();
+      b.update(t, value);
+      latencies.record(now_ns() - start);
+      user_bytes += sizeof(t) + value.size();
     }
+    io.sync();
     timer_stop(timer);
+    capture_end_batch();
     printf("%ld %ld %ld\n", j, nops/100, timer);
     overall_timer += timer;
   }
+  allocation_counters alloc = get_allocation_counters() - alloc_start;
   printf("# overall: %ld %ld\n", 100*(nops/100), overall_timer);
+  latencies.print("upsert");
+  print_allocations("upsert", alloc, 100*(nops/100), b, io);
+  print_perf("upsert", perf_snapshot() - perf_start);
+  print_io("upsert", io.get_counters() - io_start, 100*(nops/100), user_bytes);
+  print_space(b, io);
 }
 
 void benchmark_queries(betree<uint64_t, std::string> &b,
 		       uint64_t nops,
 		       uint64_t number_of_distinct_keys,
+		       key_distribution &keys,
+		       accounting_backing_store &io,
 		       uint64_t random_seed)
 {
-  
+  latency_histogram load_latencies;
+  latency_histogram query_latencies;
+
   // Pre-load the tree with data
-  srand(random_seed);
+  accounting_backing_store::counters load_start = io.get_counters();
+  perf_counters::values load_perf = perf_snapshot();
+  allocation_counters load_alloc = get_allocation_counters();
+  uint64_t user_bytes = 0;
+  keys.reset(random_seed);
   for (uint64_t i = 0; i < nops; i++) {
-    uint64_t t = rand() % number_of_distinct_keys;
-    b.update(t, std::to_string(t) + ":");
+    uint64_t t = keys.next(number_of_distinct_keys);
+    std::string value = std::to_string(t) + ":";
+    uint64_t start = now_ns();
+    b.update(t, value);
+    load_latencies.record(now_ns() - start);
+    user_bytes += sizeof(t) + value.size();
   }
+  io.sync();
+  accounting_backing_store::counters query_start = io.get_counters();
+  perf_counters::values query_perf = perf_snapshot();
+  load_perf = query_perf - load_perf;
+  allocation_counters query_alloc = get_allocation_counters();
+  load_alloc = query_alloc - load_alloc;
+  heap_usage load_heap = get_heap_usage(b, io);
 
-	// Now go back and query it
-  srand(random_seed);
+  // Now go back and query it
+  keys.reset(random_seed);
   uint64_t overall_timer = 0;
-	timer_start(overall_timer);
+  timer_start(overall_timer);
   for (uint64_t i = 0; i < nops; i++) {
-    uint64_t t = rand() % number_of_distinct_keys;
+    uint64_t t = keys.next(number_of_distinct_keys);
+    uint64_t start = now_ns();
     b.query(t);
+    query_latencies.record(now_ns() - start);
   }
-	timer_stop(overall_timer);
+  timer_stop(overall_timer);
+  query_perf = perf_snapshot() - query_perf;
+  query_alloc = get_allocation_counters() - query_alloc;
   printf("# overall: %ld %ld\n", nops, overall_timer);
+  load_latencies.print("load");
+  query_latencies.print("query");
+  print_perf("load", load_perf);
+  print_perf("query", query_perf);
+  print_allocations("load", load_alloc, nops, load_heap);
+  print_allocations("query", query_alloc, nops, b, io);
+  print_io("load", query_start - load_start, nops, user_bytes);
+  print_io("query", io.get_counters() - query_start, nops, 0);
+  print_space(b, io);
+}
 
+void benchmark_scans(betree<uint64_t, std::string> &b,
+		     swap_space &sspace,
+		     accounting_backing_store &io,
+		     uint64_t nops,
+		     uint64_t number_of_distinct_keys,
+		     uint64_t value_size,
+		     uint64_t scan_length,
+		     key_distribution &keys)
+{
+  // Pre-load the tree with data
+  std::string value(value_size, 'x');
+  for (uint64_t i = 0; i < number_of_distinct_keys; i++)
+    b.insert(i, value);
+  io.sync();
+
+  // Now scan it from random start keys
+  latency_histogram scan_latencies;
+  uint64_t keys_scanned = 0, bytes = 0;
+  uint64_t loads = sspace.stats().loads;
+  accounting_backing_store::counters io_start = io.get_counters();
+  perf_counters::values perf_start = perf_snapshot();
+  allocation_counters alloc_start = get_allocation_counters();
+  uint64_t overall_timer = 0;
+  timer_start(overall_timer);
+  for (uint64_t i = 0; i < nops; i++) {
+    uint64_t t = keys.next(number_of_distinct_keys);
+    uint64_t start = now_ns();
+    keys_scanned += b.scan(t, scan_length,
+			   [&bytes](uint64_t k, const std::string &v) {
+			     bytes += sizeof(k) + v.size();
+			   });
+    scan_latencies.record(now_ns() - start);
+  }
+  timer_stop(overall_timer);
+  loads = sspace.stats().loads - loads;
+  allocation_counters alloc = get_allocation_counters() - alloc_start;
+
+  printf("# overall: %ld %ld\n", nops, overall_timer);
+  printf("# scanned: %ld keys %ld bytes, %.0f keys/s %.0f bytes/s\n",
+	 keys_scanned, bytes,
+	 overall_timer ? 1e6 * keys_scanned / overall_timer : 0.0,
+	 overall_timer ? 1e6 * bytes / overall_timer : 0.0);
+  printf("# nodes loaded: %ld, %.2f per scan\n",
+	 loads, nops ? (double)loads / nops : 0.0);
+  scan_latencies.print("scan");
+  print_perf("scan", perf_snapshot() - perf_start);
+  print_allocations("scan", alloc, nops, b, io);
+  print_io("scan", io.get_counters() - io_start, nops, 0);
+}
+
+// The YCSB core workloads.  Each workload is a mix of reads, updates,
+// inserts, short scans and read-modify-writes over a set of records.
+// Unless overridden with -D, requests for existing records are drawn
+// from a scrambled zipfian distribution, except in workload D, which
+// favors the most recently inserted records.
+struct ycsb_workload {
+  char name;
+  double read_proportion;
+  double update_proportion;
+  double insert_proportion;
+  double scan_proportion;
+  double rmw_proportion;
+  bool read_latest;
+};
+
+static const ycsb_workload ycsb_workloads[] = {
+  //        read  update insert scan  rmw
+  { 'a',    0.50, 0.50,  0.00,  0.00, 0.00, false }, // update heavy
+  { 'b',    0.95, 0.05,  0.00,  0.00, 0.00, false }, // read mostly
+  { 'c',    1.00, 0.00,  0.00,  0.00, 0.00, false }, // read only
+  { 'd',    0.95, 0.00,  0.05,  0.00, 0.00, true  }, // read latest
+  { 'e',    0.00, 0.00,  0.05,  0.95, 0.00, false }, // short ranges
+  { 'f',    0.50, 0.00,  0.00,  0.00, 0.50, false }, // read-modify-write
+};
+
+const ycsb_workload * find_ycsb_workload(const char *mode)
+{
+  const char *prefix = "benchmark-ycsb-";
+  if (strncmp(mode, prefix, strlen(prefix)) != 0 ||
+      strlen(mode) != strlen(prefix) + 1)
+    return NULL;
+  for (unsigned int i = 0; i < sizeof(ycsb_workloads) / sizeof(ycsb_workloads[0]); i++)
+    if (ycsb_workloads[i].name == mode[strlen(prefix)])
+      return &ycsb_workloads[i];
+  return NULL;
+}
+
+std::string ycsb_value(uint64_t key, uint64_t value_size)
+{
+  return std::string(value_size, 'a' + key % 26);
+}
+
+// Everything measured during one YCSB run.
+struct ycsb_result {
+  uint64_t load_time;		// in microseconds
+  uint64_t run_time;		// in microseconds
+  uint64_t reads, updates, inserts, scans, rmws;
+  uint64_t not_found, scanned;
+  uint64_t load_user_bytes, run_user_bytes;
+  latency_histogram load_latencies, run_latencies;
+  latency_histogram read_latencies, update_latencies, insert_latencies;
+  latency_histogram scan_latencies, rmw_latencies;
+  accounting_backing_store::counters load_io, run_io;
+  perf_counters::values load_perf, run_perf;
+  allocation_counters load_alloc, run_alloc;
+  heap_usage load_heap, run_heap;
+};
+
+void run_ycsb(betree<uint64_t, std::string> &b,
+	      const ycsb_workload &workload,
+	      uint64_t nops,
+	      uint64_t number_of_records,
+	      uint64_t value_size,
+	      uint64_t max_scan_length,
+	      key_distribution &keys,
+	      accounting_backing_store &io,
+	      uint64_t operation_seed,
+	      ycsb_result &result)
+{
+  // Chooses operation types and scan lengths.  operation_seed must not
+  // be the seed of keys, or the operation would follow the key.
+  random_generator rng(operation_seed);
+  uint64_t record_size = sizeof(uint64_t) + value_size;
+
+  // Load phase
+  accounting_backing_store::counters load_start = io.get_counters();
+  perf_counters::values load_perf = perf_snapshot();
+  allocation_counters load_alloc = get_allocation_counters();
+  result.load_time = 0;
+  timer_start(result.load_time);
+  for (uint64_t i = 0; i < number_of_records; i++) {
+    uint64_t start = now_ns();
+    b.insert(i, ycsb_value(i, value_size));
+    result.load_latencies.record(now_ns() - start);
+  }
+  io.sync();
+  timer_stop(result.load_time);
+  result.load_user_bytes = number_of_records * record_size;
+
+  // Run phase
+  accounting_backing_store::counters run_start = io.get_counters();
+  perf_counters::values run_perf = perf_snapshot();
+  result.load_io = run_start - load_start;
+  result.load_perf = run_perf - load_perf;
+  allocation_counters run_alloc = get_allocation_counters();
+  result.load_alloc = run_alloc - load_alloc;
+  result.load_heap = get_heap_usage(b, io);
+  uint64_t records = number_of_records;
+  result.reads = result.updates = result.inserts = result.scans = result.rmws = 0;
+  result.not_found = result.scanned = 0;
+  result.run_time = 0;
+  timer_start(result.run_time);
+  for (uint64_t i = 0; i < nops; i++) {
+    uint64_t t = keys.next(records);
+    double p = rng.fraction();
+    latency_histogram *latencies;
+    uint64_t start = now_ns();
+    if ((p -= workload.read_proportion) < 0) {
+      try {
+	b.query(t);
+      } catch (const std::out_of_range &) {
+	result.not_found++;
+      }
+      result.reads++;
+      latencies = &result.read_latencies;
+    } else if ((p -= workload.update_proportion) < 0) {
+      b.insert(t, ycsb_value(t + i, value_size));
+      result.updates++;
+      latencies = &result.update_latencies;
+    } else if ((p -= workload.insert_proportion) < 0) {
+      b.insert(records, ycsb_value(records, value_size));
+      records++;
+      result.inserts++;
+      latencies = &result.insert_latencies;
+    } else if ((p -= workload.scan_proportion) < 0) {
+      uint64_t len = 1 + rng.uniform(max_scan_length);
+      result.scanned += b.scan(t, len,
+			       [](uint64_t, const std::string &) {});
+      result.scans++;
+      latencies = &result.scan_latencies;
+    } else {
+      capture_begin_batch();
+      try {
+	std::string v = b.query(t);
+	v[0] = 'a' + (v[0] - 'a' + 1) % 26;
+	b.insert(t, v);
+      } catch (const std::out_of_range &) {
+	result.not_found++;
+      }
+      capture_end_batch();
+      result.rmws++;
+      latencies = &result.rmw_latencies;
+    }
+    uint64_t elapsed = now_ns() - start;
+    latencies->record(elapsed);
+    result.run_latencies.record(elapsed);
+  }
+  io.sync();
+  timer_stop(result.run_time);
+  result.run_io = io.get_counters() - run_start;
+  result.run_perf = perf_snapshot() - run_perf;
+  result.run_alloc = get_allocation_counters() - run_alloc;
+  result.run_heap = get_heap_usage(b, io);
+  result.run_user_bytes =
+    (result.updates + result.inserts + result.rmws) * record_size;
+}
+
+void benchmark_ycsb(betree<uint64_t, std::string> &b,
+		    const ycsb_workload &workload,
+		    uint64_t nops,
+		    uint64_t number_of_records,
+		    uint64_t value_size,
+		    uint64_t max_scan_length,
+		    key_distribution &keys,
+		    accounting_backing_store &io,
+		    uint64_t operation_seed)
+{
+  ycsb_result r;
+  run_ycsb(b, workload, nops, number_of_records, value_size,
+	   max_scan_length, keys, io, operation_seed, r);
+
+  printf("# load: %ld %ld\n", number_of_records, r.load_time);
+  printf("# workload %c: reads %ld updates %ld inserts %ld scans %ld (%ld keys) rmws %ld not-found %ld\n",
+	 workload.name, r.reads, r.updates, r.inserts, r.scans, r.scanned,
+	 r.rmws, r.not_found);
+  printf("# overall: %ld %ld\n", nops, r.run_time);
+  r.load_latencies.print("load");
+  r.run_latencies.print("run");
+  if (r.reads)
+    r.read_latencies.print("read");
+  if (r.updates)
+    r.update_latencies.print("update");
+  if (r.inserts)
+    r.insert_latencies.print("insert");
+  if (r.scans)
+    r.scan_latencies.print("scan");
+  if (r.rmws)
+    r.rmw_latencies.print("read-modify-write");
+  print_perf("load", r.load_perf);
+  print_perf("run", r.run_perf);
+  print_allocations("load", r.load_alloc, number_of_records, r.load_heap);
+  print_allocations("run", r.run_alloc, nops, r.run_heap);
+  print_io("load", r.load_io, number_of_records, r.load_user_bytes);
+  print_io("run", r.run_io, nops, r.run_user_bytes);
+  print_space(b, io);
+}
+
+// Replay a workload trace captured with -R.  Values are synthesized
+// with the recorded sizes.  At full speed, each operation is issued
+// as soon as the previous one completes.  When paced, each operation
+// is issued at its original offset from the start of the trace, and
+// its response time is measured from that intended start, so that
+// time spent queued behind slow operations is not hidden.
+void benchmark_replay(betree<uint64_t, std::string> &b,
+		      workload_trace_reader &trace,
+		      bool paced,
+		      accounting_backing_store &io)
+{
+  latency_histogram latencies[WORKLOAD_NUM_OPS];
+  latency_histogram response_latencies, batch_latencies, lag;
+  uint64_t counts[WORKLOAD_NUM_OPS] = { 0 };
+  uint64_t nops = 0, not_found = 0, scanned = 0, user_bytes = 0;
+  uint64_t batch_depth = 0, batch_start = 0;
+  accounting_backing_store::counters io_start = io.get_counters();
+  perf_counters::values perf_start = perf_snapshot();
+  allocation_counters alloc_start = get_allocation_counters();
+
+  workload_record r;
+  uint64_t trace_time = 0;
+  uint64_t overall_timer = 0;
+  timer_start(overall_timer);
+  uint64_t due = now_ns();
+  while (trace.next(r)) {
+    due += r.delta_ns;
+    trace_time += r.delta_ns;
+    uint64_t start = now_ns();
+    if (paced) {
+      if (start < due) {
+	struct timespec ts;
+	ts.tv_sec = due / 1000000000ULL;
+	ts.tv_nsec = due % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+	  ;
+	start = now_ns();
+      }
+      lag.record(start - due);
+    }
+    uint64_t issued = paced ? due : start;
+
+    counts[r.op]++;
+    switch (r.op) {
+    case WORKLOAD_INSERT:
+      b.insert(r.key, ycsb_value(r.key, r.arg));
+      user_bytes += sizeof(r.key) + r.arg;
+      break;
+    case WORKLOAD_UPDATE:
+      b.update(r.key, ycsb_value(r.key, r.arg));
+      user_bytes += sizeof(r.key) + r.arg;
+      break;
+    case WORKLOAD_DELETE:
+      b.erase(r.key);
+      user_bytes += sizeof(r.key);
+      break;
+    case WORKLOAD_QUERY:
+      try {
+	b.query(r.key);
+      } catch (const std::out_of_range &) {
+	not_found++;
+      }
+      break;
+    case WORKLOAD_SCAN:
+      {
+	auto it = b.lower_bound(r.key);
+	for (uint64_t j = 0; j < r.arg && it != b.end(); j++, ++it)
+	  scanned++;
+      }
+      break;
+    case WORKLOAD_BEGIN_BATCH:
+      if (batch_depth++ == 0)
+	batch_start = issued;
+      continue;
+    case WORKLOAD_END_BATCH:
+      if (batch_depth > 0 && --batch_depth == 0) {
+	io.sync();
+	batch_latencies.record(now_ns() - batch_start);
+      }
+      continue;
+    }
+    uint64_t end = now_ns();
+    latencies[r.op].record(end - start);
+    response_latencies.record(end - issued);
+    nops++;
+  }
+  timer_stop(overall_timer);
+  allocation_counters alloc = get_allocation_counters() - alloc_start;
+  if (trace.failed()) {
+    std::cerr << "Unknown operation in workload trace after record "
+	      << trace.get_number_of_records() << std::endl;
+    exit(1);
+  }
+
+  printf("# replay: %s, trace duration %ld us\n",
+	 paced ? "paced" : "full speed", trace_time / 1000);
+  printf("# replay: inserts %ld updates %ld deletes %ld queries %ld scans %ld (%ld keys) batches %ld not-found %ld\n",
+	 counts[WORKLOAD_INSERT], counts[WORKLOAD_UPDATE], counts[WORKLOAD_DELETE],
+	 counts[WORKLOAD_QUERY], counts[WORKLOAD_SCAN], scanned,
+	 counts[WORKLOAD_END_BATCH], not_found);
+  printf("# overall: %ld %ld\n", nops, overall_timer);
+  for (int op = 0; op < WORKLOAD_BEGIN_BATCH; op++)
+    if (counts[op])
+      latencies[op].print(workload_op_name(op));
+  if (paced) {
+    response_latencies.print("response");
+    lag.print("schedule lag");
+  }
+  if (counts[WORKLOAD_END_BATCH])
+    batch_latencies.print("batch");
+  print_perf("replay", perf_snapshot() - perf_start);
+  print_allocations("replay", alloc, nops, b, io);
+  print_io("replay", io.get_counters() - io_start, nops, user_bytes);
+  print_space(b, io);
+}
+
+const char * default_distribution(const ycsb_workload *workload)
+{
+  if (workload == NULL)
+    return "uniform";
+  return workload->read_latest ? "latest" : "zipfian";
+}
+
+// The sweep driver runs a YCSB workload on a fresh tree for every
+// combination of node size, flush size, cache size and workload, and
+// writes one machine-readable record per combination.
+struct sweep_options {
+  std::vector<uint64_t> max_node_sizes;
+  std::vector<uint64_t> min_flush_sizes; // empty means max_node_size / 4
+  std::vector<uint64_t> cache_sizes;
+  std::vector<const ycsb_workload *> workloads;
+  const char *distribution;		 // NULL means the workload's default
+  double zipfian_theta;
+  bool json;
+};
+
+backing_store * make_backing_store(const char *type,
+				   const char *dir,
+				   uint64_t io_latency,
+				   uint64_t io_bandwidth,
+				   durability store_durability)
+{
+  if (strcmp(type, "memory") == 0)
+    return new in_memory_backing_store(1000 * io_latency,
+				       1000000 * io_bandwidth);
+  if (strcmp(type, "log") == 0)
+    return new log_backing_store(dir, store_durability);
+  if (strcmp(type, "mmap") == 0)
+    return new mmap_backing_store(dir, store_durability);
+  if (strcmp(type, "direct") == 0) {
+    direct_backing_store *store = new direct_backing_store(dir, store_durability);
+    static bool warned = false;
+    if (!store->is_direct() && !warned) {
+      std::cerr << dir << " does not support O_DIRECT, using buffered I/O" << std::endl;
+      warned = true;
+    }
+    return store;
+  }
+  return new one_file_per_object_backing_store(dir, store_durability);
+}
+
+void sweep(const sweep_options &opts,
+	   const char *backing_store_type,
+	   const char *backing_store_dir,
+	   uint64_t io_latency,
+	   uint64_t io_bandwidth,
+	   durability store_durability,
+	   uint64_t nops,
+	   uint64_t number_of_records,
+	   uint64_t value_size,
+	   uint64_t max_scan_length,
+	   uint64_t random_seed)
+{
+  const char *columns =
+    "workload,distribution,max_node_size,min_flush_size,cache_size,"
+    "ops,run_us,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,"
+    "load_write_amp,run_write_amp,reads_per_op,read_bytes_per_op,"
+    "space_amp";
+  if (opts.json)
+    printf("[\n");
+  else
+    printf("%s\n", columns);
+
+  bool first = true;
+  for (auto wit = opts.workloads.begin(); wit != opts.workloads.end(); ++wit)
+  for (auto nit = opts.max_node_sizes.begin(); nit != opts.max_node_sizes.end(); ++nit)
+  for (size_t fi = 0; fi < std::max<size_t>(opts.min_flush_sizes.size(), 1); fi++)
+  for (auto cit = opts.cache_sizes.begin(); cit != opts.cache_sizes.end(); ++cit) {
+    const ycsb_workload &workload = **wit;
+    uint64_t max_node_size = *nit;
+    uint64_t min_flush_size = opts.min_flush_sizes.empty() ?
+      max_node_size / 4 : opts.min_flush_sizes[fi];
+    uint64_t cache_size = *cit;
+    const char *distribution = opts.distribution ?
+      opts.distribution : default_distribution(&workload);
+
+    fprintf(stderr, "# workload %c N %ld f %ld C %ld\n",
+	    workload.name, max_node_size, min_flush_size, cache_size);
+
+    ycsb_result r;
+    double space_amp;
+    {
+      backing_store *store = make_backing_store(backing_store_type,
+						backing_store_dir,
+						io_latency, io_bandwidth,
+						store_durability);
+      key_distribution *keys = make_key_distribution(distribution,
+						     opts.zipfian_theta,
+						     random_seed);
+      {
+	accounting_backing_store abs(store);
+	swap_space sspace(&abs, cache_size);
+	betree<uint64_t, std::string> b(&sspace, max_node_size,
+					max_node_size / 4, min_flush_size);
+	run_ycsb(b, workload, nops, number_of_records, value_size,
+		 max_scan_length, *keys, abs,
+		 stream_seed(random_seed, OPERATION_STREAM), r);
+	uint64_t user_bytes = logical_bytes(b);
+	space_amp = user_bytes ? (double)abs.get_live_bytes() / user_bytes : 0.0;
+      }
+      delete keys;
+      delete store;
+    }
+
+    double ops_per_sec = r.run_time ? 1e6 * nops / r.run_time : 0.0;
+    double load_write_amp = r.load_user_bytes ?
+      (double)r.load_io.bytes_written / r.load_user_bytes : 0.0;
+    double run_write_amp = r.run_user_bytes ?
+      (double)r.run_io.bytes_written / r.run_user_bytes : 0.0;
+    double reads_per_op = nops ? (double)r.run_io.reads / nops : 0.0;
+    double read_bytes_per_op = nops ? (double)r.run_io.bytes_read / nops : 0.0;
+
+    if (opts.json) {
+      printf("%s  {\"workload\": \"%c\", \"distribution\": \"%s\", "
+	     "\"max_node_size\": %ld, \"min_flush_size\": %ld, \"cache_size\": %ld, "
+	     "\"ops\": %ld, \"run_us\": %ld, \"ops_per_sec\": %.1f, "
+	     "\"p50_ns\": %ld, \"p90_ns\": %ld, \"p99_ns\": %ld, \"p999_ns\": %ld, \"max_ns\": %ld, "
+	     "\"load_write_amp\": %.4f, \"run_write_amp\": %.4f, "
+	     "\"reads_per_op\": %.4f, \"read_bytes_per_op\": %.1f, "
+	     "\"space_amp\": %.4f}",
+	     first ? "" : ",\n",
+	     workload.name, distribution, max_node_size, min_flush_size, cache_size,
+	     nops, r.run_time, ops_per_sec,
+	     r.run_latencies.percentile(50), r.run_latencies.percentile(90),
+	     r.run_latencies.percentile(99), r.run_latencies.percentile(99.9),
+	     r.run_latencies.max(),
+	     load_write_amp, run_write_amp, reads_per_op, read_bytes_per_op,
+	     space_amp);
+    } else {
+      printf("%c,%s,%ld,%ld,%ld,%ld,%ld,%.1f,%ld,%ld,%ld,%ld,%ld,%.4f,%.4f,%.4f,%.1f,%.4f\n",
+	     workload.name, distribution, max_node_size, min_flush_size, cache_size,
+	     nops, r.run_time, ops_per_sec,
+	     r.run_latencies.percentile(50), r.run_latencies.percentile(90),
+	     r.run_latencies.percentile(99), r.run_latencies.percentile(99.9),
+	     r.run_latencies.max(),
+	     load_write_amp, run_write_amp, reads_per_op, read_bytes_per_op,
+	     space_amp);
+    }
+    fflush(stdout);
+    first = false;
+  }
+
+  if (opts.json)
+    printf("\n]\n");
+}
+
+// The scaling benchmark runs client threads against a set of shards.
+// Each shard is a betree with its own swap_space and backing store.
+// betree and swap_space are not thread-safe, so every operation holds
+// its shard's lock.  With one shard this measures the shared tree;
+// with one shard per thread, how far partitioning gets us.
+struct shard {
+  backing_store *store;
+  accounting_backing_store *io;
+  swap_space *sspace;
+  betree<uint64_t, std::string> *tree;
+  std::mutex lock;
+};
+
+// Keys are assigned to shards by hash.  A scan visits only the shard
+// of its start key.
+shard & shard_of(std::vector<shard *> &shards, uint64_t key)
+{
+  return *shards[fnv_hash(key) % shards.size()];
+}
+
+struct client_result {
+  latency_histogram latencies;
+  uint64_t ops;
+  uint64_t not_found;
+};
+
+void run_client(std::vector<shard *> &shards,
+		const ycsb_workload &workload,
+		uint64_t nops,
+		std::atomic<uint64_t> &records,
+		uint64_t value_size,
+		uint64_t max_scan_length,
+		key_distribution &keys,
+		uint64_t random_seed,
+		std::atomic<bool> &go,
+		client_result &result)
+{
+  random_generator rng(random_seed);
+  result.ops = result.not_found = 0;
+  while (!go.load())
+    std::this_thread::yield();
+  for (uint64_t i = 0; i < nops; i++) {
+    uint64_t t = keys.next(records.load());
+    double p = rng.fraction();
+    uint64_t start = now_ns();
+    if ((p -= workload.read_proportion) < 0) {
+      shard &s = shard_of(shards, t);
+      std::lock_guard<std::mutex> guard(s.lock);
+      try {
+	s.tree->query(t);
+      } catch (const std::out_of_range &) {
+	result.not_found++;
+      }
+    } else if ((p -= workload.update_proportion) < 0) {
+      shard &s = shard_of(shards, t);
+      std::lock_guard<std::mutex> guard(s.lock);
+      s.tree->insert(t, ycsb_value(t + i, value_size));
+    } else if ((p -= workload.insert_proportion) < 0) {
+      uint64_t k = records.fetch_add(1);
+      shard &s = shard_of(shards, k);
+      std::lock_guard<std::mutex> guard(s.lock);
+      s.tree->insert(k, ycsb_value(k, value_size));
+    } else if ((p -= workload.scan_proportion) < 0) {
+      uint64_t len = 1 + rng.uniform(max_scan_length);
+      shard &s = shard_of(shards, t);
+      std::lock_guard<std::mutex> guard(s.lock);
+      auto it = s.tree->lower_bound(t);
+      for (uint64_t j = 0; j < len && it != s.tree->end(); j++, ++it)
+	;
+    } else {
+      shard &s = shard_of(shards, t);
+      std::lock_guard<std::mutex> guard(s.lock);
+      try {
+	std::string v = s.tree->query(t);
+	v[0] = 'a' + (v[0] - 'a' + 1) % 26;
+	s.tree->insert(t, v);
+      } catch (const std::out_of_range &) {
+	result.not_found++;
+      }
+    }
+    result.latencies.record(now_ns() - start);
+    result.ops++;
+  }
+}
+
+// Run nops operations of workload, split evenly across nthreads
+// client threads, against nshards fresh shards preloaded with
+// number_of_records records.  Each shard gets an equal share of the
+// cache, so that every configuration has the same amount of memory.
+void benchmark_threads_config(const ycsb_workload &workload,
+			      const char *distribution,
+			      double zipfian_theta,
+			      uint64_t nthreads,
+			      uint64_t nshards,
+			      const char *backing_store_type,
+			      const char *backing_store_dir,
+			      uint64_t io_latency,
+			      uint64_t io_bandwidth,
+			      durability store_durability,
+			      uint64_t max_node_size,
+			      uint64_t min_flush_size,
+			      uint64_t cache_size,
+			      uint64_t nops,
+			      uint64_t number_of_records,
+			      uint64_t value_size,
+			      uint64_t max_scan_length,
+			      uint64_t random_seed,
+			      double &ops_per_sec)
+{
+  std::vector<shard *> shards;
+  std::vector<std::string> shard_dirs;
+  for (uint64_t i = 0; i < nshards; i++) {
+    std::string dir;
+    if (backing_store_dir) {
+      dir = backing_store_dir;
+      if (nshards > 1) {
+	dir += "/shard-" + std::to_string(i);
+	if (mkdir(dir.c_str(), 0755) != 0) {
+	  perror("Couldn't create shard directory");
+	  exit(1);
+	}
+	shard_dirs.push_back(dir);
+      }
+    }
+    shard *s = new shard;
+    s->store = make_backing_store(backing_store_type, dir.c_str(),
+				  io_latency, io_bandwidth, store_durability);
+    s->io = new accounting_backing_store(s->store);
+    s->sspace = new swap_space(s->io, std::max<uint64_t>(cache_size / nshards, 1));
+    s->tree = new betree<uint64_t, std::string>(s->sspace, max_node_size,
+						max_node_size / 4,
+						min_flush_size);
+    shards.push_back(s);
+  }
+
+  for (uint64_t i = 0; i < number_of_records; i++)
+    shard_of(shards, i).tree->insert(i, ycsb_value(i, value_size));
+
+  std::atomic<uint64_t> records(number_of_records);
+  std::atomic<bool> go(false);
+  std::vector<client_result> results(nthreads);
+  std::vector<key_distribution *> keys;
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < nthreads; i++) {
+    keys.push_back(make_key_distribution(distribution, zipfian_theta,
+					 stream_seed(random_seed,
+						     CLIENT_KEY_STREAM(i))));
+    uint64_t thread_ops = nops / nthreads + (i < nops % nthreads ? 1 : 0);
+    threads.push_back(std::thread(run_client, std::ref(shards),
+				  std::cref(workload), thread_ops,
+				  std::ref(records), value_size,
+				  max_scan_length, std::ref(*keys[i]),
+				  stream_seed(random_seed, CLIENT_OPERATION_STREAM(i)),
+				  std::ref(go),
+				  std::ref(results[i])));
+  }
+
+  uint64_t run_time = 0;
+  timer_start(run_time);
+  go.store(true);
+  for (auto it = threads.begin(); it != threads.end(); ++it)
+    it->join();
+  timer_stop(run_time);
+
+  latency_histogram all;
+  uint64_t ops = 0, not_found = 0;
+  for (uint64_t i = 0; i < nthreads; i++) {
+    all.merge(results[i].latencies);
+    ops += results[i].ops;
+    not_found += results[i].not_found;
+  }
+  ops_per_sec = run_time ? 1e6 * ops / run_time : 0.0;
+
+  std::string config = std::to_string(nthreads) + " threads " +
+    (nshards == 1 ? std::string("shared") :
+     std::to_string(nshards) + " shards");
+  printf("# %s: workload %c ops %ld time %ld us, %.0f ops/s, not-found %ld\n",
+	 config.c_str(), workload.name, ops, run_time, ops_per_sec, not_found);
+  all.print(config.c_str());
+  for (uint64_t i = 0; i < nthreads; i++)
+    results[i].latencies.print((config + " thread " + std::to_string(i)).c_str());
+  fflush(stdout);
+
+  for (uint64_t i = 0; i < nthreads; i++)
+    delete keys[i];
+  for (auto it = shards.begin(); it != shards.end(); ++it) {
+    delete (*it)->tree;
+    delete (*it)->sspace;
+    delete (*it)->io;
+    delete (*it)->store;
+    delete *it;
+  }
+  for (auto it = shard_dirs.begin(); it != shard_dirs.end(); ++it)
+    rmdir(it->c_str());
+}
+
+// For every thread count and workload, run the workload against one
+// shared tree and against one shard per thread.  Speedups are
+// relative to the shared tree with the first thread count.
+void benchmark_threads(const std::vector<uint64_t> &thread_counts,
+		       const std::vector<const ycsb_workload *> &workloads,
+		       const char *distribution,
+		       double zipfian_theta,
+		       const char *backing_store_type,
+		       const char *backing_store_dir,
+		       uint64_t io_latency,
+		       uint64_t io_bandwidth,
+		       durability store_durability,
+		       uint64_t max_node_size,
+		       uint64_t min_flush_size,
+		       uint64_t cache_size,
+		       uint64_t nops,
+		       uint64_t number_of_records,
+		       uint64_t value_size,
+		       uint64_t max_scan_length,
+		       uint64_t random_seed)
+{
+  for (auto wit = workloads.begin(); wit != workloads.end(); ++wit) {
+    const ycsb_workload &workload = **wit;
+    const char *dist = distribution ? distribution : default_distribution(&workload);
+    double base = 0;
+    for (auto tit = thread_counts.begin(); tit != thread_counts.end(); ++tit) {
+      double shared, sharded;
+      benchmark_threads_config(workload, dist, zipfian_theta, *tit, 1,
+			       backing_store_type, backing_store_dir,
+			       io_latency, io_bandwidth, store_durability,
+			       max_node_size,
+			       min_flush_size, cache_size, nops,
+			       number_of_records, value_size, max_scan_length,
+			       random_seed, shared);
+      if (*tit > 1)
+	benchmark_threads_config(workload, dist, zipfian_theta, *tit, *tit,
+				 backing_store_type, backing_store_dir,
+				 io_latency, io_bandwidth, store_durability,
+				 max_node_size,
+				 min_flush_size, cache_size, nops,
+				 number_of_records, value_size,
+				 max_scan_length, random_seed, sharded);
+      else
+	sharded = shared;
+      if (tit == thread_counts.begin())
+	base = shared;
+      printf("# scaling: workload %c threads %ld shared %.0f ops/s (%.2fx) sharded %.0f ops/s (%.2fx)\n",
+	     workload.name, *tit, shared, base ? shared / base : 0.0,
+	     sharded, base ? sharded / base : 0.0);
+    }
+  }
+}
+
+// Parse a comma-separated list of positive integers.  Returns false
+// on a parse error.
+bool parse_list(const char *arg, std::vector<uint64_t> &result)
+{
+  result.clear();
+  while (*arg) {
+    char *term;
+    uint64_t x = strtoull(arg, &term, 10);
+    if (term == arg || x == 0 || (*term && *term != ','))
+      return false;
+    result.push_back(x);
+    arg = *term ? term + 1 : term;
+  }
+  return !result.empty();
 }
 
 int main(int argc, char **argv)
 {
   char *mode = NULL;
-  uint64_t max_node_size = DEFAULT_TEST_MAX_NODE_SIZE;
-  uint64_t min_flush_size = DEFAULT_TEST_MIN_FLUSH_SIZE;
-  uint64_t cache_size = DEFAULT_TEST_CACHE_SIZE;
+  std::vector<uint64_t> max_node_sizes(1, DEFAULT_TEST_MAX_NODE_SIZE);
+  std::vector<uint64_t> min_flush_sizes;
+  std::vector<uint64_t> cache_sizes(1, DEFAULT_TEST_CACHE_SIZE);
+  std::vector<uint64_t> thread_counts;
+  char *sweep_workloads = (char *)"a";
+  bool json_output = false;
   char *backing_store_dir = NULL;
+  const char *backing_store_type = "file";
+  uint64_t io_latency = 0;
+  uint64_t io_bandwidth = 0;
+  durability store_durability = DURABILITY_FULL;
+  bool overwrite_in_place = false;
+  char *slow_tier_dir = NULL;
+  uint64_t fast_tier_capacity = DEFAULT_TEST_FAST_TIER_CAPACITY;
   uint64_t number_of_distinct_keys = DEFAULT_TEST_NDISTINCT_KEYS;
   uint64_t nops = DEFAULT_TEST_NOPS;
+  uint64_t value_size = DEFAULT_TEST_VALUE_SIZE;
+  uint64_t max_scan_length = DEFAULT_TEST_MAX_SCAN_LENGTH;
+  char *distribution = NULL;
+  double zipfian_theta = DEFAULT_ZIPFIAN_THETA;
   char *script_infile = NULL;
   char *script_outfile = NULL;
+  char *trace_file = NULL;
+  char *stats_file = NULL;
+  char *export_file = NULL;
+  char *frozen_file = NULL;
+  char *capture_file = NULL;
+  char *replay_file = NULL;
+  bool paced = false;
+  bool perf_enabled = false;
   unsigned int random_seed = time(NULL) * getpid();
  
   int opt;
@@ -280,7 +1499,7 @@ int main(int argc, char **argv)
   // Argument parsing //
   //////////////////////
   
-  while ((opt = getopt(argc, argv, "m:d:N:f:C:o:k:t:s:i:")) != -1) {
+  while ((opt = getopt(argc, argv, "m:d:N:f:C:o:k:t:s:i:v:l:D:z:b:L:B:Y:IS:M:w:F:T:P:X:Z:R:r:pj:HA")) != -1) {
     switch (opt) {
     case 'm':
       mode = optarg;
@@ -289,25 +1508,25 @@ int main(int argc, char **argv)
       backing_store_dir = optarg;
       break;
     case 'N':
-      max_node_size = strtoull(optarg, &term, 10);
-      if (*term) {
-	std::cerr << "Argument to -N must be an integer" << std::endl;
+      if (!parse_list(optarg, max_node_sizes)) {
+	std::cerr << "Argument to -N must be a positive integer "
+		  << "(or a comma-separated list, in sweep mode)" << std::endl;
 	usage(argv[0]);
 	exit(1);
       }
       break;
     case 'f':
-      min_flush_size = strtoull(optarg, &term, 10);
-      if (*term) {
-	std::cerr << "Argument to -f must be an integer" << std::endl;
+      if (!parse_list(optarg, min_flush_sizes)) {
+	std::cerr << "Argument to -f must be a positive integer "
+		  << "(or a comma-separated list, in sweep mode)" << std::endl;
 	usage(argv[0]);
 	exit(1);
       }
       break;
     case 'C':
-      cache_size = strtoull(optarg, &term, 10);
-      if (*term) {
-	std::cerr << "Argument to -C must be an integer" << std::endl;
+      if (!parse_list(optarg, cache_sizes)) {
+	std::cerr << "Argument to -C must be a positive integer "
+		  << "(or a comma-separated list, in sweep mode)" << std::endl;
 	usage(argv[0]);
 	exit(1);
       }
@@ -342,6 +1561,142 @@ int main(int argc, char **argv)
     case 'i':
       script_infile = optarg;
       break;
+    case 'v':
+      value_size = strtoull(optarg, &term, 10);
+      if (*term || value_size == 0) {
+	std::cerr << "Argument to -v must be a positive integer" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'l':
+      max_scan_length = strtoull(optarg, &term, 10);
+      if (*term || max_scan_length == 0) {
+	std::cerr << "Argument to -l must be a positive integer" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'D':
+      distribution = optarg;
+      break;
+    case 'z':
+      zipfian_theta = strtod(optarg, &term);
+      if (*term || !(zipfian_theta > 0 && zipfian_theta < 1)) {
+	std::cerr << "Argument to -z must be a number between 0 and 1" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'b':
+      backing_store_type = optarg;
+      if (strcmp(backing_store_type, "file") != 0 &&
+	  strcmp(backing_store_type, "memory") != 0 &&
+	  strcmp(backing_store_type, "log") != 0 &&
+	  strcmp(backing_store_type, "mmap") != 0 &&
+	  strcmp(backing_store_type, "direct") != 0 &&
+	  strcmp(backing_store_type, "tiered") != 0) {
+	std::cerr << "Argument to -b must be \"file\", \"memory\", \"log\", \"mmap\", \"direct\" or \"tiered\"" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'L':
+      io_latency = strtoull(optarg, &term, 10);
+      if (*term) {
+	std::cerr << "Argument to -L must be an integer" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'B':
+      io_bandwidth = strtoull(optarg, &term, 10);
+      if (*term) {
+	std::cerr << "Argument to -B must be an integer" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'I':
+      overwrite_in_place = true;
+      break;
+    case 'S':
+      slow_tier_dir = optarg;
+      break;
+    case 'M':
+      fast_tier_capacity = strtoull(optarg, &term, 10);
+      if (*term) {
+	std::cerr << "Argument to -M must be an integer" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'Y':
+      if (strcmp(optarg, "none") == 0)
+	store_durability = DURABILITY_NONE;
+      else if (strcmp(optarg, "ordered") == 0)
+	store_durability = DURABILITY_ORDERED;
+      else if (strcmp(optarg, "full") == 0)
+	store_durability = DURABILITY_FULL;
+      else {
+	std::cerr << "Argument to -Y must be \"none\", \"ordered\" or \"full\"" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'P':
+      stats_file = optarg;
+      break;
+    case 'X':
+      export_file = optarg;
+      break;
+    case 'Z':
+      frozen_file = optarg;
+      break;
+    case 'R':
+      capture_file = optarg;
+      break;
+    case 'r':
+      replay_file = optarg;
+      break;
+    case 'p':
+      paced = true;
+      break;
+    case 'H':
+      perf_enabled = true;
+      break;
+    case 'A':
+      report_allocations = true;
+      break;
+    case 'j':
+      if (!parse_list(optarg, thread_counts)) {
+	std::cerr << "Argument to -j must be a comma-separated list of positive integers" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'T':
+      if (!TRACE_ENABLED) {
+	std::cerr << "-T requires a build with -DTRACE" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      trace_file = optarg;
+      break;
+    case 'w':
+      sweep_workloads = optarg;
+      break;
+    case 'F':
+      if (strcmp(optarg, "csv") == 0)
+	json_output = false;
+      else if (strcmp(optarg, "json") == 0)
+	json_output = true;
+      else {
+	std::cerr << "Argument to -F must be \"csv\" or \"json\"" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
     default:
       std::cerr << "Unknown option '" << (char)opt << "'" << std::endl;
       usage(argv[0]);
@@ -355,7 +1710,12 @@ int main(int argc, char **argv)
   if (mode == NULL ||
       (strcmp(mode, "test") != 0
        && strcmp(mode, "benchmark-upserts") != 0
-			 && strcmp(mode, "benchmark-queries") != 0)) {
+       && strcmp(mode, "benchmark-queries") != 0
+       && strcmp(mode, "benchmark-scans") != 0
+       && strcmp(mode, "benchmark-sweep") != 0
+       && strcmp(mode, "benchmark-replay") != 0
+       && strcmp(mode, "benchmark-threads") != 0
+       && find_ycsb_workload(mode) == NULL)) {
     std::cerr << "Must specify a mode of \"test\" or \"benchmark\"" << std::endl;
     usage(argv[0]);
     exit(1);
@@ -374,6 +1734,104 @@ int main(int argc, char **argv)
     }
   }
   
+  if ((strcmp(mode, "benchmark-replay") == 0) != (replay_file != NULL)) {
+    std::cerr << "-r <workload_trace> is required in, and only allowed in, replay mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (paced && replay_file == NULL) {
+    std::cerr << "-p is only allowed in replay mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (perf_enabled && (strcmp(mode, "test") == 0 ||
+		       strcmp(mode, "benchmark-sweep") == 0 ||
+		       strcmp(mode, "benchmark-threads") == 0)) {
+    std::cerr << "-H is not supported in test, sweep or threads mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (report_allocations && (strcmp(mode, "test") == 0 ||
+			     strcmp(mode, "benchmark-sweep") == 0 ||
+			     strcmp(mode, "benchmark-threads") == 0)) {
+    std::cerr << "-A is not supported in test, sweep or threads mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+#ifndef COUNT_ALLOCATIONS
+  if (report_allocations) {
+    std::cerr << "-A requires building with -DCOUNT_ALLOCATIONS" << std::endl;
+    exit(1);
+  }
+#endif
+  if (overwrite_in_place && (strcmp(mode, "benchmark-sweep") == 0 ||
+			     strcmp(mode, "benchmark-threads") == 0)) {
+    std::cerr << "-I is not supported in sweep or threads mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (!thread_counts.empty() && strcmp(mode, "benchmark-threads") != 0) {
+    std::cerr << "-j is only allowed in threads mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (thread_counts.empty()) {
+    thread_counts.push_back(1);
+    thread_counts.push_back(2);
+    thread_counts.push_back(4);
+  }
+  if (capture_file && (strcmp(mode, "benchmark-sweep") == 0 ||
+		       strcmp(mode, "benchmark-threads") == 0)) {
+    std::cerr << "Cannot capture a workload trace in sweep or threads mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+
+  if (strcmp(mode, "benchmark-sweep") != 0 &&
+      (max_node_sizes.size() > 1 || min_flush_sizes.size() > 1 ||
+       cache_sizes.size() > 1)) {
+    std::cerr << "Lists of -N, -f and -C values are only allowed in sweep mode" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  uint64_t max_node_size = max_node_sizes[0];
+  uint64_t min_flush_size = min_flush_sizes.empty() ?
+    DEFAULT_TEST_MIN_FLUSH_SIZE : min_flush_sizes[0];
+  uint64_t cache_size = cache_sizes[0];
+
+  const ycsb_workload *workload = find_ycsb_workload(mode);
+  key_distribution *keys =
+    make_key_distribution(distribution ? distribution : default_distribution(workload),
+			  zipfian_theta, random_seed);
+  if (keys == NULL) {
+    std::cerr << "Unknown key distribution \"" << distribution << "\"" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+
+  sweep_options sweep_opts;
+  if (strcmp(mode, "benchmark-sweep") == 0 ||
+      strcmp(mode, "benchmark-threads") == 0) {
+    for (char *w = sweep_workloads; *w; w++) {
+      if (*w == ',')
+	continue;
+      std::string name = std::string("benchmark-ycsb-") + *w;
+      const ycsb_workload *wl = find_ycsb_workload(name.c_str());
+      if (wl == NULL) {
+	std::cerr << "Unknown YCSB workload '" << *w << "' in -w" << std::endl;
+	usage(argv[0]);
+	exit(1);
+      }
+      sweep_opts.workloads.push_back(wl);
+    }
+    sweep_opts.max_node_sizes = max_node_sizes;
+    sweep_opts.min_flush_sizes = min_flush_sizes;
+    sweep_opts.cache_sizes = cache_sizes;
+    sweep_opts.distribution = distribution;
+    sweep_opts.zipfian_theta = zipfian_theta;
+    sweep_opts.json = json_output;
+  }
+
   if (script_infile) {
     script_input = fopen(script_infile, "r");
     if (script_input == NULL) {
@@ -390,28 +1848,160 @@ int main(int argc, char **argv)
     }
   }
 
+  workload_trace_reader replay_trace;
+  if (replay_file && !replay_trace.open(replay_file)) {
+    perror("Couldn't open workload trace (or not a workload trace)");
+    exit(1);
+  }
+
+  workload_trace_writer capture_trace;
+  if (capture_file) {
+    if (!capture_trace.open(capture_file)) {
+      perror("Couldn't create workload trace");
+      exit(1);
+    }
+    capture = &capture_trace;
+  }
+
+  perf_counters perf_events;
+  if (perf_enabled) {
+    if (perf_events.open() == 0)
+      perror("Couldn't open any performance counters");
+    else
+      perf = &perf_events;
+  }
+
   srand(random_seed);
 
-  if (backing_store_dir == NULL) {
+  if (strcmp(backing_store_type, "memory") != 0 && backing_store_dir == NULL) {
     std::cerr << "-d <backing_store_directory> is required" << std::endl;
     usage(argv[0]);
     exit(1);
   }
+  if (strcmp(backing_store_type, "tiered") == 0) {
+    if (slow_tier_dir == NULL) {
+      std::cerr << "-S <slow_tier_directory> is required" << std::endl;
+      usage(argv[0]);
+      exit(1);
+    }
+    if (strcmp(mode, "benchmark-sweep") == 0 ||
+	strcmp(mode, "benchmark-threads") == 0) {
+      std::cerr << "The tiered store is not supported in sweep or threads mode" << std::endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  } else if (slow_tier_dir) {
+    std::cerr << "-S is only allowed with the tiered store" << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
   
   ////////////////////////////////////////////////////////
   // Construct a betree and run the tests or benchmarks //
   ////////////////////////////////////////////////////////
   
-  one_file_per_object_backing_store ofpobs(backing_store_dir);
-  swap_space sspace(&ofpobs, cache_size);
-  betree<uint64_t, std::string> b(&sspace, max_node_size, min_flush_size);
-
-  if (strcmp(mode, "test") == 0) 
-    test(b, nops, number_of_distinct_keys, script_input, script_output);
-  else if (strcmp(mode, "benchmark-upserts") == 0)
-    benchmark_upserts(b, nops, number_of_distinct_keys, random_seed);
-  else if (strcmp(mode, "benchmark-queries") == 0)
-    benchmark_queries(b, nops, number_of_distinct_keys, random_seed);
+  if (strcmp(mode, "benchmark-sweep") == 0) {
+    sweep(sweep_opts, backing_store_type, backing_store_dir, io_latency,
+	  io_bandwidth, store_durability, nops, number_of_distinct_keys, value_size,
+	  max_scan_length, random_seed);
+    delete keys;
+    if (trace_file && !trace_dump(trace_file))
+      perror("Couldn't write trace file");
+    return 0;
+  }
+
+  if (strcmp(mode, "benchmark-threads") == 0) {
+    benchmark_threads(thread_counts, sweep_opts.workloads, distribution,
+		      zipfian_theta, backing_store_type, backing_store_dir,
+		      io_latency, io_bandwidth, store_durability,
+		      max_node_size, min_flush_size,
+		      cache_size, nops, number_of_distinct_keys, value_size,
+		      max_scan_length, random_seed);
+    delete keys;
+    if (trace_file && !trace_dump(trace_file))
+      perror("Couldn't write trace file");
+    return 0;
+  }
+
+  heap_baseline = get_allocation_counters().live_bytes();
+  store_on_heap = strcmp(backing_store_type, "memory") == 0;
+  backing_store *store;
+  if (strcmp(backing_store_type, "tiered") == 0)
+    store = new tiered_backing_store(
+      new one_file_per_object_backing_store(backing_store_dir, store_durability),
+      new one_file_per_object_backing_store(slow_tier_dir, store_durability),
+      fast_tier_capacity << 20);
+  else
+    store = make_backing_store(backing_store_type, backing_store_dir,
+			       io_latency, io_bandwidth, store_durability);
+  {
+    accounting_backing_store abs(store);
+    swap_space sspace(&abs, cache_size);
+    sspace.set_overwrite_in_place(overwrite_in_place);
+    betree<uint64_t, std::string> b(&sspace, max_node_size, max_node_size / 4,
+				    min_flush_size);
+    workload_trace_recorder<uint64_t, std::string> recorder(capture_trace);
+    if (capture)
+      b.set_recorder(&recorder);
+
+    if (strcmp(mode, "test") == 0) 
+      test(b, nops, number_of_distinct_keys, script_input, script_output);
+    else if (strcmp(mode, "benchmark-upserts") == 0)
+      benchmark_upserts(b, nops, number_of_distinct_keys, *keys, abs);
+    else if (strcmp(mode, "benchmark-queries") == 0)
+      benchmark_queries(b, nops, number_of_distinct_keys, *keys, abs,
+		        random_seed);
+    else if (strcmp(mode, "benchmark-scans") == 0) {
+      // Scans load long runs of leaves, so let the kernel read ahead.
+      mmap_backing_store *mapped = dynamic_cast<mmap_backing_store *>(store);
+      if (mapped)
+	mapped->set_sequential(true);
+      benchmark_scans(b, sspace, abs, nops, number_of_distinct_keys, value_size,
+		      max_scan_length, *keys);
+    } else if (workload)
+      benchmark_ycsb(b, *workload, nops, number_of_distinct_keys,
+		     value_size, max_scan_length, *keys, abs,
+		     stream_seed(random_seed, OPERATION_STREAM));
+    else if (strcmp(mode, "benchmark-replay") == 0)
+      benchmark_replay(b, replay_trace, paced, abs);
+
+    log_backing_store *log = dynamic_cast<log_backing_store *>(store);
+    if (log && strcmp(mode, "test") != 0)
+      print_log(*log);
+    mmap_backing_store *mapped = dynamic_cast<mmap_backing_store *>(store);
+    if (mapped && strcmp(mode, "test") != 0)
+      print_free_space(mapped->free_space_stats());
+    direct_backing_store *direct = dynamic_cast<direct_backing_store *>(store);
+    if (direct && strcmp(mode, "test") != 0)
+      print_free_space(direct->free_space_stats());
+    tiered_backing_store *tiered = dynamic_cast<tiered_backing_store *>(store);
+    if (tiered && strcmp(mode, "test") != 0)
+      print_tiers(*tiered);
+
+    if (stats_file && !export_stats(stats_file, b, sspace))
+      perror("Couldn't write statistics file");
+
+    if (export_file &&
+	!export_sstable(b, export_file, strcmp(mode, "test") == 0))
+      perror("Couldn't write sstable");
+
+    if (frozen_file &&
+	!freeze_tree(b, frozen_file, number_of_distinct_keys,
+		     strcmp(mode, "test") == 0))
+      perror("Couldn't freeze tree");
+  }
+
+  delete keys;
+  delete store;
+
+  if (trace_file && !trace_dump(trace_file))
+    perror("Couldn't write trace file");
+
+  if (capture) {
+    capture = NULL;
+    if (!capture_trace.close())
+      perror("Couldn't write workload trace");
+  }
   
   if (script_input)
     fclose(script_input);
@@ -0,0 +1,320 @@
+#include "tiered_backing_store.hpp"
+#include <cstring>
+#include <cassert>
+
+tiered_backing_store::statistics::statistics(void)
+  : promotions(0),
+    demotions(0)
+{
+  for (int t = 0; t < NUM_TIERS; t++) {
+    objects[t] = 0;
+    bytes[t] = 0;
+  }
+}
+
+tiered_backing_store::tiered_backing_store(backing_store *fast,
+					   backing_store *slow,
+					   uint64_t fast_capacity_bytes)
+  : fast_capacity(fast_capacity_bytes),
+    nextid(1),
+    clock(0),
+    stopping(false)
+{
+  tiers[FAST] = fast;
+  tiers[SLOW] = slow;
+  migrator = std::thread(&tiered_backing_store::migrator_main, this);
+}
+
+tiered_backing_store::~tiered_backing_store(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  migrator_wakeup.notify_one();
+  migrator.join();
+  delete tiers[FAST];
+  delete tiers[SLOW];
+}
+
+tiered_backing_store::tier tiered_backing_store::place(const object &obj) const
+{
+  if (!obj.is_leaf)
+    return FAST;
+  if (counters.bytes[FAST] + obj.size <= fast_capacity)
+    return FAST;
+  return SLOW;
+}
+
+// Allocate space for a new object on the tier it belongs on.
+void tiered_backing_store::place_object(uint64_t id, object &obj)
+{
+  obj.where = place(obj);
+  obj.inner_id = tiers[obj.where]->allocate(obj.size);
+  counters.objects[obj.where]++;
+  counters.bytes[obj.where] += obj.size;
+  if (obj.where == FAST && obj.is_leaf)
+    fast_leaves.insert(std::make_pair(obj.last_read, id));
+  if (counters.bytes[FAST] > fast_capacity)
+    migrator_wakeup.notify_one();
+}
+
+void tiered_backing_store::note_read(uint64_t id, object &obj)
+{
+  if (obj.where == FAST && obj.is_leaf)
+    fast_leaves.erase(std::make_pair(obj.last_read, id));
+  obj.last_read = ++clock;
+  if (obj.reads++ == 0)
+    obj.first_read = obj.last_read;
+  if (obj.where == FAST && obj.is_leaf) {
+    fast_leaves.insert(std::make_pair(obj.last_read, id));
+  } else if (obj.where == SLOW && obj.reads >= TIERED_PROMOTE_READS &&
+	     !obj.queued) {
+    obj.queued = true;
+    promotions.push_back(id);
+    migrator_wakeup.notify_one();
+  }
+}
+
+void tiered_backing_store::read_locked(uint64_t id, buffer_stream &buf)
+{
+  assert(objects.count(id) > 0);
+  object &obj = objects[id];
+  assert(obj.inner_id > 0);
+  note_read(id, obj);
+  tiers[obj.where]->read(obj.inner_id, scratch);
+  memcpy(buf.start_read(scratch.input_size()), scratch.input(),
+	 scratch.input_size());
+}
+
+void tiered_backing_store::write_locked(uint64_t id, const char *data, size_t n)
+{
+  size_t erased = unwritten.erase(id);
+  assert(erased == 1);
+  (void)erased;
+  object &obj = objects[id];
+  if (obj.inner_id == 0)
+    place_object(id, obj);
+  tiers[obj.where]->write(obj.inner_id, data, n);
+}
+
+// Move an object to the other tier.
+void tiered_backing_store::migrate(uint64_t id, tier to)
+{
+  object &obj = objects[id];
+  tier from = obj.where;
+  assert(from != to);
+  tiers[from]->read(obj.inner_id, scratch);
+  uint64_t inner_id = tiers[to]->allocate(obj.size);
+  tiers[to]->set_is_leaf(inner_id, obj.is_leaf);
+  tiers[to]->write(inner_id, scratch.input(), scratch.input_size());
+  tiers[from]->deallocate(obj.inner_id);
+
+  if (from == FAST && obj.is_leaf)
+    fast_leaves.erase(std::make_pair(obj.last_read, id));
+  if (to == FAST && obj.is_leaf)
+    fast_leaves.insert(std::make_pair(obj.last_read, id));
+  counters.objects[from]--;
+  counters.bytes[from] -= obj.size;
+  counters.objects[to]++;
+  counters.bytes[to] += obj.size;
+  obj.where = to;
+  obj.inner_id = inner_id;
+  obj.reads = 0;
+}
+
+// The least recently read leaf on the fast tier that is not waiting
+// to be written.
+bool tiered_backing_store::find_demotion(uint64_t &id) const
+{
+  for (auto it = fast_leaves.begin(); it != fast_leaves.end(); ++it) {
+    if (unwritten.count(it->second) == 0) {
+      id = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Choose the leaves to demote so that obj fits on the fast tier.
+// Only leaves that have not been read at all while obj collected its
+// TIERED_PROMOTE_READS reads are given up for it; otherwise a
+// promotion into a full fast tier would demote something as hot or
+// hotter, which would soon be promoted back.  Returns false if no
+// such set of leaves makes enough room.
+bool tiered_backing_store::find_room(const object &obj,
+				     std::vector<uint64_t> &victims) const
+{
+  uint64_t bytes = counters.bytes[FAST];
+  for (auto it = fast_leaves.begin();
+       bytes + obj.size > fast_capacity && it != fast_leaves.end() &&
+	 it->first < obj.first_read;
+       ++it) {
+    if (unwritten.count(it->second))
+      continue;
+    victims.push_back(it->second);
+    bytes -= objects.at(it->second).size;
+  }
+  return bytes + obj.size <= fast_capacity;
+}
+
+// Demote while the fast tier is over capacity, then promote.  The
+// lock is dropped between migrations so that foreground reads and
+// writes can get in.
+void tiered_backing_store::migrator_main(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    uint64_t id;
+    if (counters.bytes[FAST] > fast_capacity && find_demotion(id)) {
+      migrate(id, SLOW);
+      counters.demotions++;
+    } else if (!promotions.empty()) {
+      id = promotions.front();
+      promotions.pop_front();
+      if (objects.count(id) == 0)
+	continue;
+      object &obj = objects[id];
+      obj.queued = false;
+      if (obj.where != SLOW || unwritten.count(id))
+	continue;
+      std::vector<uint64_t> victims;
+      if (!find_room(obj, victims)) {
+	// Make it earn another TIERED_PROMOTE_READS reads.
+	obj.reads = 0;
+	continue;
+      }
+      for (auto it = victims.begin(); it != victims.end(); ++it) {
+	migrate(*it, SLOW);
+	counters.demotions++;
+      }
+      migrate(id, FAST);
+      counters.promotions++;
+    } else {
+      migrator_wakeup.wait(guard);
+      continue;
+    }
+    guard.unlock();
+    guard.lock();
+  }
+}
+
+uint64_t tiered_backing_store::allocate(size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  uint64_t id = nextid++;
+  object &obj = objects[id];
+  obj.where = FAST;
+  obj.inner_id = 0;
+  obj.size = n;
+  obj.is_leaf = true;
+  obj.queued = false;
+  obj.reads = 0;
+  obj.first_read = clock;
+  obj.last_read = clock;
+  unwritten.insert(id);
+  return id;
+}
+
+void tiered_backing_store::deallocate(uint64_t id)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  assert(objects.count(id) > 0);
+  object &obj = objects[id];
+  if (obj.inner_id > 0) {
+    tiers[obj.where]->deallocate(obj.inner_id);
+    if (obj.where == FAST && obj.is_leaf)
+      fast_leaves.erase(std::make_pair(obj.last_read, id));
+    counters.objects[obj.where]--;
+    counters.bytes[obj.where] -= obj.size;
+  }
+  objects.erase(id);
+  unwritten.erase(id);
+}
+
+bool tiered_backing_store::overwrite(uint64_t id, size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  assert(objects.count(id) > 0);
+  object &obj = objects[id];
+  if (!tiers[obj.where]->overwrite(obj.inner_id, n))
+    return false;
+  counters.bytes[obj.where] = counters.bytes[obj.where] - obj.size + n;
+  obj.size = n;
+  unwritten.insert(id);
+  return true;
+}
+
+void tiered_backing_store::set_is_leaf(uint64_t id, bool is_leaf)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  assert(objects.count(id) > 0);
+  object &obj = objects[id];
+  if (obj.inner_id > 0 && obj.where == FAST && obj.is_leaf != is_leaf) {
+    if (is_leaf)
+      fast_leaves.insert(std::make_pair(obj.last_read, id));
+    else
+      fast_leaves.erase(std::make_pair(obj.last_read, id));
+  }
+  obj.is_leaf = is_leaf;
+  if (obj.inner_id > 0)
+    tiers[obj.where]->set_is_leaf(obj.inner_id, is_leaf);
+}
+
+// Streams are served from the tiered store's own buffers, so that a
+// migration can never pull an object out from under one.
+std::iostream * tiered_backing_store::get(uint64_t id)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  buffer_stream *bs = new buffer_stream;
+  if (unwritten.count(id)) {
+    bs->start_write();
+    writes[bs] = id;
+  } else {
+    read_locked(id, *bs);
+  }
+  return bs;
+}
+
+void tiered_backing_store::put(std::iostream *ios)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  buffer_stream *bs = (buffer_stream *)ios;
+  auto it = writes.find(ios);
+  if (it != writes.end()) {
+    write_locked(it->second, bs->data(), bs->written());
+    writes.erase(it);
+  }
+  delete bs;
+}
+
+void tiered_backing_store::read(uint64_t id, buffer_stream &buf)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  read_locked(id, buf);
+}
+
+void tiered_backing_store::write(uint64_t id, const char *data, size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  write_locked(id, data, n);
+}
+
+void tiered_backing_store::sync(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  tiers[FAST]->sync();
+  tiers[SLOW]->sync();
+}
+
+uint64_t tiered_backing_store::get_number_of_syncs(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return tiers[FAST]->get_number_of_syncs() + tiers[SLOW]->get_number_of_syncs();
+}
+
+tiered_backing_store::statistics tiered_backing_store::stats(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return counters;
+}
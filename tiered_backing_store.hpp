@@ -0,0 +1,120 @@
+// A backing_store that spreads objects over a fast and a slow store,
+// e.g. one directory on flash and one on disk.
+
+// Internal nodes always go to the fast tier when they are written,
+// since every query reads them.  Leaves go to the fast tier while it
+// is below its capacity, and otherwise to the slow tier.  A leaf on
+// the slow tier that is read TIERED_PROMOTE_READS times is promoted
+// to the fast tier if it fits there, or if demoting leaves that have
+// not been read since the first of those reads makes room; otherwise
+// its read count starts over.  Whenever the fast tier is over its
+// capacity, the least recently read leaves on it are demoted to the
+// slow tier.  Promotions and demotions are done by a background
+// thread, so reads and writes do not queue behind them.  A migration
+// does its tier I/O (including any syncs the tiers' durability mode
+// calls for) under the store's mutex, though, so a foreground call
+// that arrives during one waits for that one migration to finish.
+
+// swap_space tells the store which objects are leaves through
+// set_is_leaf().  Objects it has not been told about are treated as
+// leaves.
+
+// The tiered store owns its two tiers and deletes them when it is
+// destroyed.  All calls into the tiers are serialized by a mutex, so
+// the tiers need not be thread-safe.  Because the migration thread
+// may use a tier at any time, read() copies objects into the
+// caller's buffer rather than lending it a tier's memory.
+
+#ifndef TIERED_BACKING_STORE_HPP
+#define TIERED_BACKING_STORE_HPP
+
+#include "backing_store.hpp"
+#include <set>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define TIERED_PROMOTE_READS (4)
+
+class tiered_backing_store: public backing_store {
+public:
+  enum tier {
+    FAST,
+    SLOW,
+    NUM_TIERS
+  };
+
+  class statistics {
+  public:
+    statistics(void);
+
+    uint64_t objects[NUM_TIERS];
+    uint64_t bytes[NUM_TIERS];
+    uint64_t promotions;
+    uint64_t demotions;
+  };
+
+  tiered_backing_store(backing_store *fast, backing_store *slow,
+		       uint64_t fast_capacity_bytes);
+  ~tiered_backing_store(void);
+
+  uint64_t	  allocate(size_t n);
+  void		  deallocate(uint64_t id);
+  std::iostream * get(uint64_t id);
+  void            put(std::iostream *ios);
+  void            read(uint64_t id, buffer_stream &buf);
+  void            write(uint64_t id, const char *data, size_t n);
+  bool            overwrite(uint64_t id, size_t n);
+  void            set_is_leaf(uint64_t id, bool is_leaf);
+  void            sync(void);
+  uint64_t        get_number_of_syncs(void) const;
+
+  statistics stats(void) const;
+
+private:
+  class object {
+  public:
+    tier where;
+    uint64_t inner_id;		// 0 until the object is first written
+    uint64_t size;
+    bool is_leaf;
+    bool queued;		// for promotion
+    uint64_t reads;		// since the object was last migrated
+    uint64_t first_read;	// clock at the first of those reads
+    uint64_t last_read;
+  };
+
+  // All of the following require the lock to be held.
+  tier place(const object &obj) const;
+  void place_object(uint64_t id, object &obj);
+  void note_read(uint64_t id, object &obj);
+  void read_locked(uint64_t id, buffer_stream &buf);
+  void write_locked(uint64_t id, const char *data, size_t n);
+  void migrate(uint64_t id, tier to);
+  bool find_demotion(uint64_t &id) const;
+  bool find_room(const object &obj, std::vector<uint64_t> &victims) const;
+
+  void migrator_main(void);
+
+  backing_store *tiers[NUM_TIERS];
+  uint64_t	fast_capacity;
+  uint64_t	nextid;
+  uint64_t	clock;
+  std::unordered_map<uint64_t, object> objects;
+  // Leaves on the fast tier, least recently read first.
+  std::set<std::pair<uint64_t, uint64_t> > fast_leaves;
+  std::deque<uint64_t> promotions;
+  std::unordered_set<uint64_t> unwritten;
+  std::unordered_map<std::iostream *, uint64_t> writes;
+  buffer_stream scratch;
+  statistics	counters;
+
+  mutable std::mutex lock;
+  std::condition_variable migrator_wakeup;
+  bool		stopping;
+  std::thread	migrator;
+};
+
+#endif // TIERED_BACKING_STORE_HPP
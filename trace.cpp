@@ -0,0 +1,115 @@
+#include "trace.hpp"
+#include <cstdio>
+#include <ctime>
+#include <vector>
+#include <mutex>
+
+static uint64_t trace_clock_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+class trace_buffer {
+public:
+  trace_buffer(uint64_t tid)
+    : events(TRACE_BUFFER_EVENTS),
+      next(0),
+      tid(tid)
+  {}
+
+  void record(const trace_event &e) {
+    events[next % events.size()] = e;
+    next++;
+  }
+
+  std::vector<trace_event> events;
+  uint64_t next;
+  uint64_t tid;
+};
+
+// Buffers are never freed, so that the events of threads that have
+// exited can still be dumped.
+static std::mutex buffers_lock;
+static std::vector<trace_buffer *> buffers;
+static thread_local trace_buffer *local_buffer = NULL;
+
+static void trace_record(const trace_event &e)
+{
+  if (local_buffer == NULL) {
+    std::lock_guard<std::mutex> guard(buffers_lock);
+    local_buffer = new trace_buffer(buffers.size() + 1);
+    buffers.push_back(local_buffer);
+  }
+  local_buffer->record(e);
+}
+
+trace_span::trace_span(const char *name, uint64_t id)
+{
+  event.name = name;
+  event.phase = 'X';
+  event.id = id;
+  event.arg_names[0] = event.arg_names[1] = NULL;
+  event.args[0] = event.args[1] = 0;
+  event.start_ns = trace_clock_ns();
+}
+
+trace_span::~trace_span(void)
+{
+  event.duration_ns = trace_clock_ns() - event.start_ns;
+  trace_record(event);
+}
+
+void trace_instant(const char *name, uint64_t id,
+		   const char *arg_name, uint64_t arg)
+{
+  trace_event e;
+  e.name = name;
+  e.phase = 'i';
+  e.start_ns = trace_clock_ns();
+  e.duration_ns = 0;
+  e.id = id;
+  e.arg_names[0] = arg_name;
+  e.args[0] = arg;
+  e.arg_names[1] = NULL;
+  e.args[1] = 0;
+  trace_record(e);
+}
+
+static void dump_event(FILE *out, const trace_event &e, uint64_t tid, bool first)
+{
+  fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,",
+	  first ? "" : ",\n", e.name, e.phase, e.start_ns / 1000.0);
+  if (e.phase == 'X')
+    fprintf(out, "\"dur\":%.3f,", e.duration_ns / 1000.0);
+  else
+    fprintf(out, "\"s\":\"t\",");
+  fprintf(out, "\"pid\":1,\"tid\":%lu,\"args\":{\"id\":%lu", tid, e.id);
+  for (int i = 0; i < 2; i++)
+    if (e.arg_names[i])
+      fprintf(out, ",\"%s\":%lu", e.arg_names[i], e.args[i]);
+  fprintf(out, "}}");
+}
+
+bool trace_dump(const char *filename)
+{
+  FILE *out = fopen(filename, "w");
+  if (out == NULL)
+    return false;
+
+  std::lock_guard<std::mutex> guard(buffers_lock);
+  bool first = true;
+  fprintf(out, "{\"traceEvents\":[\n");
+  for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+    trace_buffer *buf = *it;
+    uint64_t size = buf->events.size();
+    uint64_t begin = buf->next > size ? buf->next - size : 0;
+    for (uint64_t i = begin; i < buf->next; i++) {
+      dump_event(out, buf->events[i % size], buf->tid, first);
+      first = false;
+    }
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  return fclose(out) == 0;
+}
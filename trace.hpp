@@ -0,0 +1,72 @@
+// Low-overhead event tracing of the hot paths in the betree and the
+// swap_space: flushes, splits, merges, loads, write-backs and
+// evictions.
+
+// Tracing is compiled in only when TRACE is defined (see the
+// Makefile).  Otherwise the TRACE_* macros below expand to nothing
+// and their arguments are never evaluated.
+
+// Each thread records events into its own fixed-size ring buffer, so
+// recording an event takes no locks.  When a buffer fills up, its
+// oldest events are overwritten.  trace_dump() writes the buffered
+// events of all threads in the Chrome trace event format, which can
+// be loaded into chrome://tracing or https://ui.perfetto.dev.
+
+// Events are either spans, which cover the lifetime of a
+// TRACE_SPAN variable and are recorded when it goes out of scope, or
+// instants.  Every event carries an id (a node or object id) and up
+// to two named integer arguments, such as sizes.
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+
+// Number of events each thread's ring buffer holds.
+#define TRACE_BUFFER_EVENTS (1ULL << 16)
+
+class trace_event {
+public:
+  const char *name;
+  char phase;			// 'X' for spans, 'i' for instants
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  uint64_t id;
+  const char *arg_names[2];
+  uint64_t args[2];
+};
+
+class trace_span {
+public:
+  trace_span(const char *name, uint64_t id);
+  ~trace_span(void);
+  void set_arg(int i, const char *name, uint64_t value) {
+    event.arg_names[i] = name;
+    event.args[i] = value;
+  }
+
+private:
+  trace_event event;
+};
+
+void trace_instant(const char *name, uint64_t id,
+		   const char *arg_name, uint64_t arg);
+
+// Write all buffered events to filename as Chrome trace JSON.  Only
+// call this while no other thread is recording events.  Returns false
+// if the file could not be written.
+bool trace_dump(const char *filename);
+
+#ifdef TRACE
+#define TRACE_SPAN(var, name, id) trace_span var(name, id)
+#define TRACE_ARG(var, i, name, value) var.set_arg(i, name, value)
+#define TRACE_INSTANT(name, id, arg_name, arg) trace_instant(name, id, arg_name, arg)
+#define TRACE_ENABLED (true)
+#else
+#define TRACE_SPAN(var, name, id)
+#define TRACE_ARG(var, i, name, value)
+#define TRACE_INSTANT(name, id, arg_name, arg)
+#define TRACE_ENABLED (false)
+#endif
+
+#endif // TRACE_HPP
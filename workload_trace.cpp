@@ -0,0 +1,159 @@
+#include "workload_trace.hpp"
+#include <cstring>
+#include <ctime>
+
+static uint64_t workload_clock_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+const char * workload_op_name(int op)
+{
+  static const char *names[WORKLOAD_NUM_OPS] = {
+    "insert", "update", "delete", "query", "scan", "begin-batch", "end-batch"
+  };
+  if (op < 0 || op >= WORKLOAD_NUM_OPS)
+    return "unknown";
+  return names[op];
+}
+
+/////////////////////////////////////////////////
+// Implementation of the workload_trace_writer //
+/////////////////////////////////////////////////
+workload_trace_writer::workload_trace_writer(void)
+  : out(NULL),
+    last_ns(0),
+    records(0)
+{}
+
+workload_trace_writer::~workload_trace_writer(void)
+{
+  close();
+}
+
+bool workload_trace_writer::open(const char *filename)
+{
+  if (out)
+    close();
+  out = fopen(filename, "wb");
+  if (out == NULL)
+    return false;
+  uint32_t version = WORKLOAD_TRACE_VERSION;
+  unsigned char v[4] = { (unsigned char)version, (unsigned char)(version >> 8),
+			 (unsigned char)(version >> 16), (unsigned char)(version >> 24) };
+  fwrite(WORKLOAD_TRACE_MAGIC, 1, 8, out);
+  fwrite(v, 1, 4, out);
+  last_ns = workload_clock_ns();
+  records = 0;
+  return true;
+}
+
+bool workload_trace_writer::close(void)
+{
+  if (out == NULL)
+    return true;
+  bool ok = !ferror(out);
+  ok = fclose(out) == 0 && ok;
+  out = NULL;
+  return ok;
+}
+
+void workload_trace_writer::put_varint(uint64_t x)
+{
+  while (x >= 0x80) {
+    putc_unlocked((x & 0x7f) | 0x80, out);
+    x >>= 7;
+  }
+  putc_unlocked(x, out);
+}
+
+void workload_trace_writer::record(int op, uint64_t key, uint64_t arg)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (out == NULL)
+    return;
+  uint64_t now = workload_clock_ns();
+  putc_unlocked(op, out);
+  put_varint(now - last_ns);
+  put_varint(key);
+  put_varint(arg);
+  last_ns = now;
+  records++;
+}
+
+/////////////////////////////////////////////////
+// Implementation of the workload_trace_reader //
+/////////////////////////////////////////////////
+workload_trace_reader::workload_trace_reader(void)
+  : in(NULL),
+    bad(false),
+    records(0)
+{}
+
+workload_trace_reader::~workload_trace_reader(void)
+{
+  close();
+}
+
+bool workload_trace_reader::open(const char *filename)
+{
+  close();
+  bad = false;
+  records = 0;
+  in = fopen(filename, "rb");
+  if (in == NULL)
+    return false;
+  char magic[8];
+  unsigned char v[4];
+  if (fread(magic, 1, 8, in) != 8 ||
+      memcmp(magic, WORKLOAD_TRACE_MAGIC, 8) != 0 ||
+      fread(v, 1, 4, in) != 4 ||
+      (v[0] | v[1] << 8 | v[2] << 16 | (uint32_t)v[3] << 24) != WORKLOAD_TRACE_VERSION) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void workload_trace_reader::close(void)
+{
+  if (in)
+    fclose(in);
+  in = NULL;
+}
+
+bool workload_trace_reader::get_varint(uint64_t &x)
+{
+  x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc_unlocked(in);
+    if (c == EOF)
+      return false;
+    x |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool workload_trace_reader::next(workload_record &r)
+{
+  if (in == NULL)
+    return false;
+  if (bad)
+    return false;
+  int c = getc_unlocked(in);
+  if (c == EOF)
+    return false;
+  if (c >= WORKLOAD_NUM_OPS) {
+    bad = true;
+    return false;
+  }
+  r.op = c;
+  if (!(get_varint(r.delta_ns) && get_varint(r.key) && get_varint(r.arg)))
+    return false;
+  records++;
+  return true;
+}
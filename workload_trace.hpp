@@ -0,0 +1,174 @@
+// Compact binary traces of the operations an application performs on
+// a betree, with their timing, for later replay (see the
+// benchmark-replay mode of the test program).
+
+// A trace file starts with the 8-byte magic WORKLOAD_TRACE_MAGIC and
+// a 4-byte little-endian version, followed by one record per
+// operation:
+//   1 byte   op (one of the workload_op values below)
+//   varint   nanoseconds since the previous record (or since the
+//            trace was opened, for the first record)
+//   varint   key
+//   varint   argument: the value size for inserts and updates, the
+//            number of keys requested for scans (which stop early at
+//            the end of the tree), and 0 otherwise
+// Varints are LEB128: 7 bits per byte, least significant first, with
+// the high bit set on all but the last byte.  A typical record with a
+// small key and a short inter-arrival time takes 4-6 bytes.
+
+// Batch boundaries are recorded as BEGIN_BATCH and END_BATCH records
+// with key and argument 0.  The application decides what a batch is
+// (e.g. a request, a transaction or a group commit).
+
+// An application captures its workload by giving its betree a
+// workload_trace_recorder (below) with betree::set_recorder(), which
+// records upserts, queries and scans made through betree::scan(), and
+// by marking batches on the writer itself.
+
+#ifndef WORKLOAD_TRACE_HPP
+#define WORKLOAD_TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include "betree.hpp"
+
+#define WORKLOAD_TRACE_MAGIC "BeTrWkld"
+#define WORKLOAD_TRACE_VERSION (1)
+
+enum workload_op {
+  WORKLOAD_INSERT = 0,
+  WORKLOAD_UPDATE = 1,
+  WORKLOAD_DELETE = 2,
+  WORKLOAD_QUERY = 3,
+  WORKLOAD_SCAN = 4,
+  WORKLOAD_BEGIN_BATCH = 5,
+  WORKLOAD_END_BATCH = 6,
+  WORKLOAD_NUM_OPS = 7
+};
+
+const char * workload_op_name(int op);
+
+class workload_record {
+public:
+  int op;
+  uint64_t delta_ns;
+  uint64_t key;
+  uint64_t arg;
+};
+
+// Appends records to a trace file.  record() may be called from
+// several threads at once; their records are interleaved in the
+// order in which they acquire the writer's lock.
+class workload_trace_writer {
+public:
+  workload_trace_writer(void);
+  ~workload_trace_writer(void);
+
+  // Returns false if the file could not be created.
+  bool open(const char *filename);
+  // Returns false if any record could not be written.
+  bool close(void);
+
+  void record(int op, uint64_t key, uint64_t arg);
+  void begin_batch(void) { record(WORKLOAD_BEGIN_BATCH, 0, 0); }
+  void end_batch(void) { record(WORKLOAD_END_BATCH, 0, 0); }
+
+  uint64_t get_number_of_records(void) const { return records; }
+
+private:
+  void put_varint(uint64_t x);
+
+  FILE *out;
+  std::mutex lock;
+  uint64_t last_ns;
+  uint64_t records;
+};
+
+class workload_trace_reader {
+public:
+  workload_trace_reader(void);
+  ~workload_trace_reader(void);
+
+  // Returns false if the file could not be opened or is not a
+  // workload trace of a supported version.
+  bool open(const char *filename);
+  void close(void);
+
+  // Returns false at the end of the trace or at a record with an
+  // unknown op, after which failed() is true.  A truncated final
+  // record is treated as the end of the trace, since a capture cut
+  // short by a crash ends with one.
+  bool next(workload_record &r);
+
+  bool failed(void) const { return bad; }
+  // The number of records next() has returned.
+  uint64_t get_number_of_records(void) const { return records; }
+
+private:
+  bool get_varint(uint64_t &x);
+
+  FILE *in;
+  bool bad;
+  uint64_t records;
+};
+
+// Keys are recorded as 64-bit integers.  workload_trace_recorder finds
+// the recorded form of its keys, and the sizes of its values, through
+// these overloads; other key and value types can add their own.
+// String keys are recorded by hash, so a replay preserves their
+// popularity but not their order.
+static inline uint64_t workload_key(uint64_t key)
+{
+  return key;
+}
+
+static inline uint64_t workload_key(const std::string &key)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size(); i++) {
+    h ^= (unsigned char)key[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+template<class Value>
+uint64_t workload_value_size(const Value &value)
+{
+  return sizeof(value);
+}
+
+static inline uint64_t workload_value_size(const std::string &value)
+{
+  return value.size();
+}
+
+// A betree_recorder that appends a betree's operations to a trace.
+template<class Key, class Value>
+class workload_trace_recorder : public betree_recorder<Key, Value> {
+public:
+  workload_trace_recorder(workload_trace_writer &writer)
+    : writer(writer)
+  {}
+
+  void upsert(int opcode, const Key &k, const Value &v) {
+    static const int ops[] = { WORKLOAD_INSERT, WORKLOAD_DELETE, WORKLOAD_UPDATE };
+    writer.record(ops[opcode], workload_key(k),
+		  opcode == DELETE ? 0 : workload_value_size(v));
+  }
+
+  void query(const Key &k) {
+    writer.record(WORKLOAD_QUERY, workload_key(k), 0);
+  }
+
+  void scan(const Key &k, uint64_t n) {
+    writer.record(WORKLOAD_SCAN, workload_key(k), n);
+  }
+
+private:
+  workload_trace_writer &writer;
+};
+
+#endif // WORKLOAD_TRACE_HPP